@@ -10,90 +10,332 @@
 #define AUTOTRACKER_H
 
 #include "pyramid.hpp"
-#include <algorithm>
-#include <functional>
-#include <numeric>
-#include <iostream>
-#include <stdexcept>
+#include <cassert>
+#include <cstddef>
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace flying_dragon
 {
 
+/// @brief Motion energy kernels
+///
+/// Each pixel's energy is an exponential average of its
+/// squared frame differences:
+///
+///     e = e - ceil (e / 2^shift) + (d * d >> shift)
+///
+/// where d is the frame difference.  Squares above 65535
+/// saturate, and then the energy can never pass 65535, so it
+/// is kept in 16 bits.  Shifting each term separately means
+/// differences too small to survive the shift are ignored.
+/// Rounding the decay up means the energy of a pixel that
+/// stops changing always gets back to 0.
+///
+/// One sweep updates the energy, copies the frame into the
+/// last frame, and finds the first pixel with the most
+/// energy.  The scalar and vector paths give identical
+/// results.
+namespace motion_energy
+{
+    /// @brief The largest energy
+    const unsigned MAX_ENERGY = 65535;
+
+    /// @brief Get a saturated squared difference
+    template<typename T>
+    inline unsigned Square (T a, T b)
+    {
+        const double d = a < b ? static_cast<double> (b) - a : static_cast<double> (a) - b;
+        // 256 * 256 is the first square that does not fit
+        return d >= 256 ? MAX_ENERGY : static_cast<unsigned> (d * d);
+    }
+    /// @brief Get a squared difference of 8 bit pixels
+    inline unsigned Square (unsigned char a, unsigned char b)
+    {
+        const int d = a - b;
+        return d * d;
+    }
+    /// @brief Sweep part of a frame, scalar version
+    /// @param f The frame
+    /// @param last The last frame, replaced by this one
+    /// @param energy The energy at each pixel
+    /// @param shift The decay shift
+    /// @param begin First pixel to sweep
+    /// @param end One past the last pixel to sweep
+    /// @param best The most energy seen so far, -1 if none
+    /// @param best_index Where the most energy was seen
+    template<typename T>
+    inline void Sweep (const T *f,
+        T *last,
+        unsigned short *energy,
+        unsigned shift,
+        size_t begin,
+        size_t end,
+        int &best,
+        size_t &best_index)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const unsigned old_e = energy[i];
+            const unsigned decay = (old_e + (1u << shift) - 1) >> shift;
+            const int e = static_cast<int> (old_e - decay + (Square (f[i], last[i]) >> shift));
+            energy[i] = static_cast<unsigned short> (e);
+            last[i] = f[i];
+            if (e > best)
+            {
+                best = e;
+                best_index = i;
+            }
+        }
+    }
+    /// @brief Sweep the start of a frame, vector version
+    /// @return The number of pixels swept
+    ///
+    /// There is only a vector version for 8 bit pixels.
+    template<typename T>
+    inline size_t SweepSIMD (const T *,
+        T *,
+        unsigned short *,
+        unsigned,
+        size_t,
+        int &,
+        size_t &)
+    {
+        return 0;
+    }
+#if defined (__SSE2__)
+    /// @brief Get ceil (e / 2^shift) of 8 energies
+    /// @param e The energies
+    /// @param count The shift
+    /// @param low_bits 2^shift - 1 in each lane
+    /// @param one 1 in each lane
+    inline __m128i Decay (__m128i e, __m128i count, __m128i low_bits, __m128i one)
+    {
+        // The compare gives -1 where no bits are shifted out
+        const __m128i exact = _mm_cmpeq_epi16 (_mm_and_si128 (e, low_bits), _mm_setzero_si128 ());
+        return _mm_add_epi16 (_mm_add_epi16 (_mm_srl_epi16 (e, count), one), exact);
+    }
+    /// @brief Sweep the start of a frame, 16 pixels at a time
+    /// @return The number of pixels swept
+    ///
+    /// A squared 8 bit difference fits in 16 unsigned bits.
+    /// SSE2 has no unsigned 16 bit compare, so energies are
+    /// compared with their sign bits flipped.  The decay is
+    /// rounded up by adding one wherever bits are shifted out,
+    /// since rounding before the shift could overflow.  The
+    /// best energy only grows, so the rare block that beats it
+    /// is searched for its first maximum with scalar code.
+    inline size_t SweepSIMD (const unsigned char *f,
+        unsigned char *last,
+        unsigned short *energy,
+        unsigned shift,
+        size_t n,
+        int &best,
+        size_t &best_index)
+    {
+        const __m128i zero = _mm_setzero_si128 ();
+        const __m128i sign = _mm_set1_epi16 (-0x8000);
+        const __m128i count = _mm_cvtsi32_si128 (static_cast<int> (shift));
+        const __m128i one = _mm_set1_epi16 (1);
+        const __m128i low_bits = _mm_set1_epi16 (static_cast<short> ((1 << shift) - 1));
+        // Everything beats -1, which flips to the smallest value
+        __m128i best_flipped = _mm_set1_epi16 (static_cast<short> ((best < 0 ? 0 : best) ^ 0x8000));
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m128i a = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (f + i));
+            const __m128i b = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (last + i));
+            _mm_storeu_si128 (reinterpret_cast<__m128i *> (last + i), a);
+            const __m128i dlo = _mm_sub_epi16 (_mm_unpacklo_epi8 (a, zero), _mm_unpacklo_epi8 (b, zero));
+            const __m128i dhi = _mm_sub_epi16 (_mm_unpackhi_epi8 (a, zero), _mm_unpackhi_epi8 (b, zero));
+            __m128i *plo = reinterpret_cast<__m128i *> (energy + i);
+            __m128i *phi = reinterpret_cast<__m128i *> (energy + i + 8);
+            __m128i elo = _mm_loadu_si128 (plo);
+            __m128i ehi = _mm_loadu_si128 (phi);
+            elo = _mm_add_epi16 (_mm_sub_epi16 (elo, Decay (elo, count, low_bits, one)),
+                _mm_srl_epi16 (_mm_mullo_epi16 (dlo, dlo), count));
+            ehi = _mm_add_epi16 (_mm_sub_epi16 (ehi, Decay (ehi, count, low_bits, one)),
+                _mm_srl_epi16 (_mm_mullo_epi16 (dhi, dhi), count));
+            _mm_storeu_si128 (plo, elo);
+            _mm_storeu_si128 (phi, ehi);
+            const __m128i gt = _mm_or_si128 (
+                _mm_cmpgt_epi16 (_mm_xor_si128 (elo, sign), best_flipped),
+                _mm_cmpgt_epi16 (_mm_xor_si128 (ehi, sign), best_flipped));
+            if (_mm_movemask_epi8 (gt) != 0 || best < 0)
+            {
+                for (size_t j = i; j < i + 16; ++j)
+                {
+                    if (static_cast<int> (energy[j]) > best)
+                    {
+                        best = energy[j];
+                        best_index = j;
+                    }
+                }
+                best_flipped = _mm_set1_epi16 (static_cast<short> (best ^ 0x8000));
+            }
+        }
+        return i;
+    }
+#endif
+}
+
+/// @brief Follow the motion in a video
+///
+/// Each frame, the energy of every pixel at one pyramid
+/// level is updated and the fixation moves part of the way
+/// towards the pixel with the most energy.  While the most
+/// energy is below a threshold there is no motion to follow,
+/// and the fixation stays where it is.  Only one frame and
+/// one 16 bit energy per pixel are kept.
 template<typename T>
 class Autotracker
 {
     public:
-    Autotracker (size_t level = 3)
+    /// @brief Constructor
+    /// @param level The pyramid level to track at
+    /// @param decay_shift Energy decays by 2^-decay_shift
+    /// each frame
+    /// @param smoothing_percent How far the fixation moves
+    /// towards the peak each frame
+    /// @param min_energy The least energy that is followed
+    Autotracker (size_t level = 3,
+        unsigned decay_shift = 1,
+        int smoothing_percent = 10,
+        unsigned min_energy = 1)
         : level_ (level)
-        , total_frames_ (16)
-        , frame_diffs_ (total_frames_)
-        , n_frame_ (0)
-        , superpixel_size_ (1 << level_)
+        , decay_shift_ (decay_shift)
+        , smoothing_percent_ (smoothing_percent)
+        , min_energy_ (min_energy)
+        , last_fx_ (0)
+        , last_fy_ (0)
     {
+        assert (decay_shift_ >= 1 && decay_shift_ <= MAX_DECAY_SHIFT);
+        assert (smoothing_percent_ > 0 && smoothing_percent_ <= 100);
+        assert (min_energy_ >= 1);
     }
-    void get_fixation (const jsp::pyramid<T> &p, int &fx, int &fy)
+    /// @brief Set the pyramid level to track at
+    ///
+    /// Tracking starts over at the next frame.
+    void set_level (size_t level)
+    {
+        level_ = level;
+        reset ();
+    }
+    /// @brief Get the pyramid level
+    size_t get_level () const
+    {
+        return level_;
+    }
+    /// @brief Set how fast the energy decays
+    /// @param decay_shift Energy decays by 2^-decay_shift
+    /// each frame, so larger shifts remember longer
+    void set_decay_shift (unsigned decay_shift)
+    {
+        assert (decay_shift >= 1 && decay_shift <= MAX_DECAY_SHIFT);
+        decay_shift_ = decay_shift;
+    }
+    /// @brief Set how far the fixation moves each frame
+    /// @param smoothing_percent Percent of the distance to
+    /// the peak, 100 to jump right to it
+    void set_smoothing (int smoothing_percent)
+    {
+        assert (smoothing_percent > 0 && smoothing_percent <= 100);
+        smoothing_percent_ = smoothing_percent;
+    }
+    /// @brief Set the least energy that is followed
+    /// @param min_energy The energy, at least 1
+    ///
+    /// A pixel whose frames differ by d each frame settles at
+    /// an energy of about d * d.
+    void set_min_energy (unsigned min_energy)
+    {
+        assert (min_energy >= 1);
+        min_energy_ = min_energy;
+    }
+    /// @brief Get the least energy that is followed
+    unsigned get_min_energy () const
+    {
+        return min_energy_;
+    }
+    /// @brief Forget all motion
+    void reset ()
+    {
+        total_energy_ = jsp::raster<unsigned short> ();
+        last_frame_ = jsp::raster<T> ();
+    }
+    /// @brief Track the next frame
+    /// @param p The frame's pyramid
+    /// @param fx Set to the fixation column
+    /// @param fy Set to the fixation row
+    /// @return The most energy in the frame
+    ///
+    /// The fixation is in full resolution pixels.
+    unsigned get_fixation (const jsp::pyramid<T> &p, int &fx, int &fy)
     {
         assert (level_ < p.levels ());
-        const size_t ROWS = p[level_].rows ();
-        const size_t COLS = p[level_].cols ();
-        const jsp::raster<T> &f = p[level_];
+        return get_fixation (p[level_], fx, fy);
+    }
+    /// @brief Track the next frame
+    /// @param f The frame, already reduced to the tracking
+    /// level
+    /// @param fx Set to the fixation column
+    /// @param fy Set to the fixation row
+    /// @return The most energy in the frame
+    ///
+    /// The fixation is in full resolution pixels.  It does not
+    /// move while the most energy is below the minimum.
+    unsigned get_fixation (const jsp::raster<T> &f, int &fx, int &fy)
+    {
+        const size_t ROWS = f.rows ();
+        const size_t COLS = f.cols ();
+        const size_t superpixel_size = size_t (1) << level_;
         if (f.size () != last_frame_.size ())
         {
-            for (size_t i = 0; i < total_frames_; ++i)
-                frame_diffs_[i].resize (ROWS, COLS, 0);
             total_energy_.resize (ROWS, COLS, 0);
             last_frame_ = f;
-            last_fx_ = COLS / 2;
-            last_fy_ = ROWS / 2;
-            return;
+            last_fx_ = static_cast<int> (COLS * superpixel_size / 2);
+            last_fy_ = static_cast<int> (ROWS * superpixel_size / 2);
+            fx = last_fx_;
+            fy = last_fy_;
+            return 0;
         }
         assert (f.size () == last_frame_.size ());
-        assert (f.size () == frame_diffs_[n_frame_].size ());
         assert (f.size () == total_energy_.size ());
-        // Get the diff at each pixel
-        transform (f.begin (),
-            f.end (),
-            last_frame_.begin (),
-            frame_diffs_[n_frame_].begin (),
-            std::minus<int> ());
-        // Square each pixel
-        transform (frame_diffs_[n_frame_].begin (),
-            frame_diffs_[n_frame_].end (),
-            frame_diffs_[n_frame_].begin (),
-            frame_diffs_[n_frame_].begin (),
-            std::multiplies<int> ());
-        // Keep a running total at each pixel
-        transform (frame_diffs_[n_frame_].begin (),
-            frame_diffs_[n_frame_].end (),
-            total_energy_.begin (),
-            total_energy_.begin (),
-            std::plus<int> ());
-        // Attenuate energy over time
-        transform (total_energy_.begin (),
-            total_energy_.end (),
-            total_energy_.begin (),
-            bind2nd (std::divides<int> (), 2));
-        jsp::raster<int>::iterator i = max_element (total_energy_.begin (), total_energy_.end ());
-        int new_fx = static_cast<int> (total_energy_.col (i) * superpixel_size_ + superpixel_size_ / 2);
-        int new_fy = static_cast<int> (total_energy_.row (i) * superpixel_size_ + superpixel_size_ / 2);
+        // Update the energy and find its peak in one pass
+        const T *src = &*f.begin ();
+        T *last = &*last_frame_.begin ();
+        unsigned short *energy = &*total_energy_.begin ();
+        int best = -1;
+        size_t best_index = 0;
+        const size_t done = motion_energy::SweepSIMD (src, last, energy, decay_shift_, f.size (), best, best_index);
+        motion_energy::Sweep (src, last, energy, decay_shift_, done, f.size (), best, best_index);
+        // Hold the fixation while there is no motion to follow
+        const unsigned peak = best < 0 ? 0 : static_cast<unsigned> (best);
+        if (peak < min_energy_)
+        {
+            fx = last_fx_;
+            fy = last_fy_;
+            return peak;
+        }
+        int new_fx = static_cast<int> ((best_index % COLS) * superpixel_size + superpixel_size / 2);
+        int new_fy = static_cast<int> ((best_index / COLS) * superpixel_size + superpixel_size / 2);
         int dx = new_fx - last_fx_;
         int dy = new_fy - last_fy_;
-        fx = last_fx_ + dx / 10;
-        fy = last_fy_ + dy / 10;
+        fx = last_fx_ + dx * smoothing_percent_ / 100;
+        fy = last_fy_ + dy * smoothing_percent_ / 100;
         last_fx_ = fx;
         last_fy_ = fy;
-        last_frame_ = f;
-        ++n_frame_;
-        n_frame_ %= total_frames_;
+        return peak;
     }
     private:
-    const size_t level_;
-    const size_t total_frames_;
-    std::vector<jsp::raster<int> > frame_diffs_;
-    jsp::raster<int> total_energy_;
+    static const unsigned MAX_DECAY_SHIFT = 15;
+    size_t level_;
+    unsigned decay_shift_;
+    int smoothing_percent_;
+    unsigned min_energy_;
+    jsp::raster<unsigned short> total_energy_;
     jsp::raster<T> last_frame_;
-    size_t n_frame_;
-    const size_t superpixel_size_;
     int last_fx_, last_fy_;
 };
 
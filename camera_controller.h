@@ -10,22 +10,25 @@
 #define CAMERA_CONTROLLER_H
 
 #include "camera.h"
-#include "colorspace.h"
-#include "raster.h"
+#include "capture_source.h"
+#include "capture_thread.h"
+#include "video_frame.h"
+#include <cassert>
 #include <string>
 #include <QDebug>
 #include <QImage>
 #include <QObject>
 #include <QString>
-#include <QTimer>
 
 namespace flying_dragon
 {
 
 /// @brief High level camera controller
 ///
-/// Enhances a Camera interface by adding signals/slots and
-/// better error handling.
+/// Enhances a CaptureSource by adding signals/slots and
+/// better error handling.  Frames are captured on a
+/// CaptureThread and the signals are emitted on the thread
+/// that owns the controller.
 class CameraController : public QObject
 {
     Q_OBJECT
@@ -33,120 +36,140 @@ class CameraController : public QObject
     public slots:
     /// @brief Open a camera
     /// @param device_name The device name
+    /// @param width Frame width to use if the name has none,
+    /// or 0
+    /// @param height Frame height to use if the name has none,
+    /// or 0
+    /// @param fps Frame rate to use if the name has none, or 0
     ///
-    /// Open and setup a camera device.  For example
-    /// "/dev/video".
-    void Open (const QString &device_name)
+    /// Open and setup a capture source.  For example
+    /// "/dev/video", "synthetic:640x480@30", or "clip.y4m".
+    /// See CreateCaptureSource() for the choices.
+    void Open (const QString &device_name,
+        unsigned width = 0, unsigned height = 0, unsigned fps = 0)
     {
-        //camera_.SetLog (std::clog);
-        camera_.Open (device_name.toStdString ().c_str ());
-        camera_.InitBuffers (WIDTH_HINT, HEIGHT_HINT);
-        unsigned w, h;
-        jsp::Camera::PixelFormat p;
-        jsp::Camera::Colorspace c;
-        camera_.GetCaptureFormat (w, h, p, c);
-        if (p != jsp::Camera::PixelFormatYUYV)
-            throw jsp::CameraGeneralException ("Unsupported pixel format");
-        if (c != jsp::Camera::ColorspaceSRGB)
-            throw jsp::CameraGeneralException ("Unsupported colorspace");
-        Resize (w, h);
-        QObject::connect (&timer_, SIGNAL(timeout()),
-            this, SLOT(GetFrame()));
+        Close ();
+        source_ = CreateCaptureSource (device_name.toStdString (), width, height, fps);
+        try
+        {
+            source_->Open ();
+        }
+        catch (...)
+        {
+            delete source_;
+            source_ = 0;
+            throw;
+        }
+        Resize (source_->GetWidth (), source_->GetHeight ());
     }
     /// @brief Close a camera
     void Close ()
     {
-        camera_.Close ();
+        if (!source_)
+            return;
+        source_->Close ();
+        delete source_;
+        source_ = 0;
     }
     /// @brief Start capturing
-    /// @param timer_msec Min msec between frames
     ///
-    /// The amount of time required between frames depends
-    /// on the device and how it is set up.
-    void StartCapture (int timer_msec = 10)
+    /// Frames are delivered as fast as the device produces
+    /// them, which depends on the device and how it is set up.
+    void StartCapture ()
     {
-        camera_.StartCapture ();
-        timer_.start (timer_msec);
+        assert (source_);
+        source_->StartCapture ();
+        capture_thread_.Start (source_);
     }
     /// @brief Stop capturing
     void StopCapture ()
     {
-        timer_.stop ();
-        camera_.StopCapture ();
+        capture_thread_.Stop ();
+        if (source_)
+            source_->StopCapture ();
     }
 
     signals:
     /// @brief A new frame is available
     /// @param frame The frame
     ///
-    /// The referenced frame is temporary storage.  You have
-    /// a limited amount of time to process it.
+    /// Each frame has its own pixels, so it is safe to hold
+    /// on to it.
     void NewFrame (const QImage &frame);
     /// @brief A new icon is available
     /// @param icon The icon
     ///
-    /// The referenced icon is temporary storage.  You have
-    /// a limited amount of time to process it.
+    /// Each icon has its own pixels, so it is safe to hold
+    /// on to it.
     void NewIcon (const QImage &icon);
+    /// @brief A new frame is available for sending
+    /// @param frame The frame and its YV12 planes
+    void NewVideoFrame (const VideoFrame &frame);
 
     public:
+    /// @brief Constructor
+    CameraController ()
+        : source_ (0)
+        , width_ (0)
+        , height_ (0)
+        , capture_thread_ (ICON_SIZE)
+    {
+        QObject::connect (&capture_thread_, SIGNAL(FrameReady()),
+            this, SLOT(GetFrames()), Qt::QueuedConnection);
+        QObject::connect (&capture_thread_, SIGNAL(CaptureError(const QString &)),
+            this, SLOT(CaptureError(const QString &)), Qt::QueuedConnection);
+    }
+    /// @brief Destructor
+    ~CameraController ()
+    {
+        StopCapture ();
+        Close ();
+    }
     /// @brief Get a pointer to the camera
+    /// @return The camera, or 0 if the source is not a camera
     jsp::Camera *GetCamera ()
-    { return &camera_; }
+    { return source_ ? source_->GetCamera () : 0; }
     /// @brief Get the frame width
     ///
     /// You must call Open() before you call this function
     size_t GetWidth () const
-    { return y_frame_.cols (); }
+    { return width_; }
     /// @brief Get the frame height
     ///
     /// You must call Open() before you call this function
     size_t GetHeight () const
-    { return y_frame_.rows (); }
+    { return height_; }
 
     private slots:
-    void GetFrame ()
+    void GetFrames ()
+    {
+        QQueue<CapturedFrame> frames = capture_thread_.TakeFrames ();
+        while (!frames.isEmpty ())
+        {
+            CapturedFrame f = frames.dequeue ();
+            emit NewIcon (f.icon);
+            emit NewFrame (f.frame.GetImage ());
+            emit NewVideoFrame (f.frame);
+        }
+    }
+    void CaptureError (const QString &what)
     {
-        const unsigned char *frame =
-            static_cast<const unsigned char *> (camera_.GetFrame (TIMEOUT_SECS));
-        // Convert it to planar yuv
-        jsp::YUYV2YV12 (frame, y_frame_, u_frame_, v_frame_);
-        // Convert it to ARGB
-        jsp::YV122ARGB (y_frame_, u_frame_, v_frame_, argb_frame_);
-        // Convert it to a QImage
-        frame_ = QImage (
-            &argb_frame_[0],
-            y_frame_.cols (),
-            y_frame_.rows (),
-            QImage::Format_RGB32);
-        // Scale it down to an icon
-        icon_ = frame_.scaled (64, 64);
-        // Send signals
-        emit NewIcon (icon_);
-        emit NewFrame (frame_);
+        throw jsp::CameraGeneralException (what.toStdString ().c_str ());
     }
 
     private:
-    /// @brief Resize the internal frame buffers
+    /// @brief Set the frame size
     void Resize (unsigned w, unsigned h)
     {
-        y_frame_.resize (h, w, 0xff);
-        u_frame_.resize (h / 2, w / 2, 0xff);
-        v_frame_.resize (h / 2, w / 2, 0xff);
-        argb_frame_.resize (h, w * 4, 0xff);
+        width_ = w;
+        height_ = h;
     }
 
-    jsp::Camera camera_;
-    static const unsigned WIDTH_HINT = 320;
-    static const unsigned HEIGHT_HINT = 240;
-    static const unsigned TIMEOUT_SECS = 3;
-    jsp::raster<unsigned char> y_frame_;
-    jsp::raster<unsigned char> u_frame_;
-    jsp::raster<unsigned char> v_frame_;
-    jsp::raster<unsigned char> argb_frame_;
-    QTimer timer_;
-    QImage icon_;
-    QImage frame_;
+    CaptureSource *source_;
+    static const int ICON_SIZE = 64;
+    unsigned width_;
+    unsigned height_;
+    CaptureThread capture_thread_;
 };
 
 } // namespace flying_dragon
@@ -135,13 +135,15 @@ class CameraControllerWidget : public QToolBar
 
         device_name_ = new QComboBox (this);
         device_name_->setObjectName(QString("DeviceName"));
-        device_name_->setEditable (false);
-        device_name_->setToolTip ("Choose a camera device");
+        // Other capture sources, like files, can be typed in
+        device_name_->setEditable (true);
+        device_name_->setToolTip ("Choose a camera device or capture source");
         device_name_->addItem (QString ("/dev/video"));
         device_name_->addItem (QString ("/dev/video0"));
         device_name_->addItem (QString ("/dev/video1"));
         device_name_->addItem (QString ("/dev/video2"));
         device_name_->addItem (QString ("/dev/video3"));
+        device_name_->addItem (QString ("synthetic"));
         addWidget (device_name_);
 
         QIcon start_icon;
@@ -177,11 +179,12 @@ class CameraControllerWidget : public QToolBar
     void DoStart ()
     {
         camera_controller_->Open (device_name_->currentText ());
-        camera_controller_->StartCapture (10);
+        camera_controller_->StartCapture ();
         device_name_->setEnabled (false);
         start_action_->setEnabled (true);
         view_action_->setEnabled (true);
-        settings_action_->setEnabled (true);
+        // Only cameras have settings
+        settings_action_->setEnabled (camera_controller_->GetCamera () != 0);
     }
     void DoStop ()
     {
@@ -40,6 +40,9 @@ class CameraControlsDialog : public PersistentDialog
     void SetupUI ()
     {
         assert (camera_manager_);
+        // Only cameras have controls
+        if (!camera_manager_->Camera ())
+            return;
         QGridLayout *gridLayout;
         gridLayout = new QGridLayout(this);
 
@@ -9,6 +9,7 @@
 #ifndef CAMERA_DIALOG_H
 #define CAMERA_DIALOG_H
 
+#include "frame.h"
 #include "persistent_dialog.h"
 #include <QAction>
 #include <QDebug>
@@ -33,6 +34,10 @@ class CameraView : public QGraphicsView
 {
     Q_OBJECT
 
+    signals:
+    /// @brief A new background image has been painted
+    void Painted ();
+
     public:
     /// @brief Constructor
     /// @param parent Parent widget
@@ -41,6 +46,7 @@ class CameraView : public QGraphicsView
         : QGraphicsView (parent)
         , margin_ (margin)
         , stretch_ (false)
+        , new_background_ (false)
     {
     }
     /// @brief Get stretch param
@@ -57,27 +63,7 @@ class CameraView : public QGraphicsView
         {
             if (stretch_)
             {
-                QRect r = geometry ();
-                int w = r.width ();
-                int h = r.height ();
-                // Don't allow the image to shrink
-                if (w < background_image_.width ())
-                    w = background_image_.width ();
-                if (h < background_image_.height ())
-                    h = background_image_.height ();
-                assert (background_image_.width () != 0);
-                assert (background_image_.height () != 0);
-                // Keep the image's aspect ratio
-                const float aspect = background_image_.width () * 1.0 / background_image_.height ();
-                if (w > h * aspect)
-                    w = h * aspect;
-                else if (h > w / aspect)
-                    h = w / aspect;
-                r.setLeft (-w / 2);
-                r.setWidth (w);
-                r.setTop (-h / 2);
-                r.setHeight (h);
-                painter->drawImage (r, background_image_);
+                painter->drawImage (ImageRect (), background_image_);
             }
             else
             {
@@ -86,19 +72,66 @@ class CameraView : public QGraphicsView
                     background_image_);
             }
         }
+        if (new_background_)
+        {
+            new_background_ = false;
+            emit Painted ();
+        }
+    }
+    /// @brief Map a scene position to image coordinates
+    /// @param pos The scene position
+    /// @return The corresponding background image pixel
+    QPoint MapToImage (const QPointF &pos) const
+    {
+        if (background_image_.isNull ())
+            return QPoint (0, 0);
+        const QRect r = ImageRect ();
+        assert (r.width () != 0);
+        assert (r.height () != 0);
+        const int x = static_cast<int> ((pos.x () - r.left ()) * background_image_.width () / r.width ());
+        const int y = static_cast<int> ((pos.y () - r.top ()) * background_image_.height () / r.height ());
+        return QPoint (x, y);
     }
     /// @brief Set the background image
     /// @param bg Background image
     void SetBackground (const QImage &bg)
     {
         background_image_ = bg;
+        new_background_ = true;
         scene ()->invalidate ();
     }
 
     private:
+    /// @brief Get the scene rectangle covered by the image
+    QRect ImageRect () const
+    {
+        int w = background_image_.width ();
+        int h = background_image_.height ();
+        if (stretch_)
+        {
+            QRect r = geometry ();
+            w = r.width ();
+            h = r.height ();
+            // Don't allow the image to shrink
+            if (w < background_image_.width ())
+                w = background_image_.width ();
+            if (h < background_image_.height ())
+                h = background_image_.height ();
+            assert (background_image_.width () != 0);
+            assert (background_image_.height () != 0);
+            // Keep the image's aspect ratio
+            const float aspect = background_image_.width () * 1.0 / background_image_.height ();
+            if (w > h * aspect)
+                w = h * aspect;
+            else if (h > w / aspect)
+                h = w / aspect;
+        }
+        return QRect (-w / 2, -h / 2, w, h);
+    }
     QImage background_image_;
     int margin_;
     bool stretch_;
+    bool new_background_;
 };
 
 /// @brief Camera scene object
@@ -114,26 +147,28 @@ class CameraScene : public QGraphicsScene
     /// @param parent Parent widget
     CameraScene (QObject *parent = 0)
         : QGraphicsScene (parent)
-        , e2_ (10)
+        , e2_ (Frame::DEFAULT_E2)
     {
     }
     void mouseMoveEvent (QGraphicsSceneMouseEvent *event)
     {
         QPointF pos = event->scenePos ();
         //qDebug () << pos;
-        emit NewFixation (pos.x (), pos.y (), 0);
+        emit NewFixation (pos.x (), pos.y (), e2_);
     }
     void wheelEvent (QGraphicsSceneWheelEvent *event)
     {
         QPointF pos = event->scenePos ();
+        // One wheel notch is a delta of 120
         int delta = event->delta ();
-        e2_ += delta;
+        e2_ = qMax (1, e2_ + delta / E2_WHEEL_DIVISOR);
         //qDebug () << pos << delta;
         emit NewFixation (pos.x (), pos.y (), e2_);
     }
 
     private:
     int e2_;
+    static const int E2_WHEEL_DIVISOR = 24;
 };
 
 /// @brief Dialog for displaying video
@@ -145,8 +180,10 @@ class CameraDialog : public PersistentDialog
     /// @brief The dialog's fixation was updated
     /// @param x X coord
     /// @param y Y coord
-    /// @param delta E2 delta
-    void NewFixation (int x, int y, int delta);
+    /// @param e2 E2 in image pixels
+    void NewFixation (int x, int y, int e2);
+    /// @brief The newest frame has been painted
+    void Painted ();
 
     public slots:
     /// @brief A new frame has been generated
@@ -181,6 +218,16 @@ class CameraDialog : public PersistentDialog
             show ();
         }
     }
+    /// @brief The scene's fixation was updated
+    ///
+    /// Scene coordinates are centered on the view, so
+    /// convert them to image pixel coordinates before
+    /// passing them on.
+    void SceneFixation (int x, int y, int e2)
+    {
+        QPoint p = ui_.camera_view->MapToImage (QPointF (x, y));
+        emit NewFixation (p.x (), p.y (), e2);
+    }
     /// @brief The stretch toggle slot
     void on_action_Stretch_toggled (bool checked)
     {
@@ -273,7 +320,9 @@ class CameraDialog : public PersistentDialog
         gridLayout->addWidget (ui_.camera_view, 1, 0);
         gridLayout->setContentsMargins (0, 0, 0, 0);
         QObject::connect (ui_.camera_scene, SIGNAL(NewFixation(int,int,int)),
-            this, SIGNAL(NewFixation(int,int,int)));
+            this, SLOT(SceneFixation(int,int,int)));
+        QObject::connect (ui_.camera_view, SIGNAL(Painted()),
+            this, SIGNAL(Painted()));
         resize (DEFAULT_WIDTH + MARGIN, DEFAULT_HEIGHT + MARGIN + ui_.tool_bar->height ());
         QMetaObject::connectSlotsByName (this);
     }
@@ -10,8 +10,10 @@
 #define CAMERA_MANAGER_H
 
 #include "camera.h"
-#include "colorspace.h"
+#include "capture_source.h"
 #include "raster.h"
+#include "yuyv.h"
+#include <cassert>
 #include <string>
 #include <QTime>
 
@@ -21,42 +23,51 @@ namespace flying_dragon
 class CameraManager
 {
     public:
+    CameraManager ()
+        : source_ (0)
+    {
+    }
+    ~CameraManager ()
+    {
+        delete source_;
+    }
+    /// @brief Open a capture source
+    /// @param device_name See CreateCaptureSource()
     void Open (const std::string &device_name)
     {
-        //camera_.SetLog (std::clog);
-        camera_.Open (device_name.c_str ());
-        camera_.InitBuffers (WIDTH_HINT, HEIGHT_HINT);
-        unsigned w, h;
-        jsp::Camera::PixelFormat p;
-        jsp::Camera::Colorspace c;
-        camera_.GetCaptureFormat (w, h, p, c);
-        if (p != jsp::Camera::PixelFormatYUYV)
-            throw std::runtime_error ("Unsupported pixel format");
-        if (c != jsp::Camera::ColorspaceSRGB)
-            throw std::runtime_error ("Unsupported colorspace");
-        Resize (w, h);
-        camera_.StartCapture ();
+        delete source_;
+        source_ = 0;
+        source_ = CreateCaptureSource (device_name);
+        source_->Open ();
+        Resize (source_->GetWidth (), source_->GetHeight ());
+        source_->StartCapture ();
         // Sometimes you get junk in the first few
         // frames...
+        if (!source_->GetCamera ())
+            return;
         QTime t;
         t.start ();
         while (t.elapsed () < 250)
-            camera_.GetFrame (TIMEOUT);
+            source_->GetFrame (TIMEOUT);
     }
     jsp::Camera *Camera ()
-    { return &camera_; }
+    { return source_ ? source_->GetCamera () : 0; }
     size_t FrameWidth () const
     { return y_frame_.cols (); }
     size_t FrameHeight () const
     { return y_frame_.rows (); }
     void GetFrame ()
     {
-        const unsigned char *frame =
-            static_cast<const unsigned char *> (camera_.GetFrame (TIMEOUT));
-        // Convert it to planar yuv
-        jsp::YUYV2YV12 (frame, y_frame_, u_frame_, v_frame_);
-        // Convert it to ARGB
-        jsp::YV122ARGB (y_frame_, u_frame_, v_frame_, argb_frame_);
+        assert (source_);
+        const unsigned char *frame = source_->GetFrame (TIMEOUT);
+        // Convert it to ARGB and planar yuv in one pass
+        YUYV2RGB32 (frame,
+            y_frame_.cols (),
+            y_frame_.rows (),
+            &argb_frame_[0],
+            &y_frame_[0],
+            &u_frame_[0],
+            &v_frame_[0]);
     }
     const unsigned char *YFrame () const
     { return &y_frame_[0]; }
@@ -74,9 +85,7 @@ class CameraManager
         v_frame_.resize (h / 2, w / 2, 0xff);
         argb_frame_.resize (h, w * 4, 0xff);
     }
-    jsp::Camera camera_;
-    static const unsigned WIDTH_HINT = 320;
-    static const unsigned HEIGHT_HINT = 240;
+    CaptureSource *source_;
     static const unsigned TIMEOUT = 3;
     jsp::raster<unsigned char> y_frame_;
     jsp::raster<unsigned char> u_frame_;
@@ -0,0 +1,600 @@
+// Capture Sources
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 17:20:36 CDT 2026
+
+#ifndef CAPTURE_SOURCE_H
+#define CAPTURE_SOURCE_H
+
+#include "camera.h"
+#include "clock.h"
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <time.h>
+#include <vector>
+
+namespace flying_dragon
+{
+
+/// @brief A source of YUYV video frames
+///
+/// Frames are packed YUYV: each pair of pixels is four bytes,
+/// Y0 U Y1 V.  Errors are reported by throwing
+/// jsp::CameraGeneralException.
+class CaptureSource
+{
+    public:
+    /// @brief Destructor
+    virtual ~CaptureSource ()
+    {
+    }
+    /// @brief Open the source and find out the frame size
+    virtual void Open () = 0;
+    /// @brief Close the source
+    virtual void Close () = 0;
+    /// @brief Start delivering frames
+    virtual void StartCapture () = 0;
+    /// @brief Stop delivering frames
+    virtual void StopCapture () = 0;
+    /// @brief Wait for the next frame
+    /// @param timeout_secs How long to wait
+    /// @return The frame, which is valid until the next call
+    virtual const unsigned char *GetFrame (unsigned timeout_secs) = 0;
+    /// @brief Get the frame width
+    virtual unsigned GetWidth () const = 0;
+    /// @brief Get the frame height
+    virtual unsigned GetHeight () const = 0;
+    /// @brief Get the camera behind the source
+    /// @return The camera, or 0 if the source has no camera
+    /// settings
+    virtual jsp::Camera *GetCamera ()
+    {
+        return 0;
+    }
+};
+
+/// @brief Deliver frames at a fixed rate
+class FramePacer
+{
+    public:
+    /// @brief Constructor
+    /// @param fps Frames per second, or 0 for as fast as
+    /// possible
+    FramePacer (unsigned fps = 0)
+        : fps_ (fps)
+        , next_ (0)
+    {
+    }
+    /// @brief Set the frame rate
+    void SetRate (unsigned fps)
+    {
+        fps_ = fps;
+        Reset ();
+    }
+    /// @brief Make the next frame due right away
+    void Reset ()
+    {
+        next_ = 0;
+    }
+    /// @brief Get the frame rate
+    unsigned GetRate () const
+    {
+        return fps_;
+    }
+    /// @brief Sleep until the next frame is due
+    void Wait ()
+    {
+        if (fps_ == 0)
+            return;
+        const quint64 now = MonotonicMicroseconds ();
+        // Don't try to catch up after a stall
+        if (next_ == 0 || now > next_ + 1000000 / fps_)
+            next_ = now;
+        if (next_ > now)
+        {
+            const quint64 usecs = next_ - now;
+            timespec ts;
+            ts.tv_sec = usecs / 1000000;
+            ts.tv_nsec = (usecs % 1000000) * 1000;
+            while (nanosleep (&ts, &ts) != 0 && errno == EINTR)
+            {
+            }
+        }
+        next_ += 1000000 / fps_;
+    }
+
+    private:
+    unsigned fps_;
+    quint64 next_;
+};
+
+/// @brief Frames from a V4L2 camera
+class V4L2CaptureSource : public CaptureSource
+{
+    public:
+    /// @brief Constructor
+    /// @param device_name The device, for example "/dev/video"
+    /// @param width_hint The frame width to ask for, or 0 for
+    /// the default
+    /// @param height_hint The frame height to ask for, or 0
+    /// for the default
+    /// @param max_fps Drop frames to stay under this rate, or
+    /// 0 to keep every frame
+    V4L2CaptureSource (const std::string &device_name,
+        unsigned width_hint = 0, unsigned height_hint = 0, unsigned max_fps = 0)
+        : device_name_ (device_name)
+        , width_hint_ (width_hint ? width_hint : WIDTH_HINT)
+        , height_hint_ (height_hint ? height_hint : HEIGHT_HINT)
+        , max_fps_ (max_fps)
+        , next_ (0)
+        , width_ (0)
+        , height_ (0)
+    {
+    }
+    void Open ()
+    {
+        //camera_.SetLog (std::clog);
+        camera_.Open (device_name_.c_str ());
+        // The driver picks the nearest size it supports
+        camera_.InitBuffers (width_hint_, height_hint_);
+        jsp::Camera::PixelFormat p;
+        jsp::Camera::Colorspace c;
+        camera_.GetCaptureFormat (width_, height_, p, c);
+        if (p != jsp::Camera::PixelFormatYUYV)
+            throw jsp::CameraGeneralException ("Unsupported pixel format");
+        if (c != jsp::Camera::ColorspaceSRGB)
+            throw jsp::CameraGeneralException ("Unsupported colorspace");
+    }
+    void Close ()
+    {
+        camera_.Close ();
+    }
+    void StartCapture ()
+    {
+        next_ = 0;
+        camera_.StartCapture ();
+    }
+    void StopCapture ()
+    {
+        camera_.StopCapture ();
+    }
+    const unsigned char *GetFrame (unsigned timeout_secs)
+    {
+        for (;;)
+        {
+            const unsigned char *frame =
+                static_cast<const unsigned char *> (camera_.GetFrame (timeout_secs));
+            if (max_fps_ == 0)
+                return frame;
+            // The camera sets the pace, so allow some jitter
+            // rather than dropping every other frame when the
+            // rates are close
+            const quint64 interval = 1000000 / max_fps_;
+            const quint64 now = MonotonicMicroseconds ();
+            if (next_ == 0 || now > next_ + interval)
+                next_ = now;
+            if (now + interval / 4 >= next_)
+            {
+                next_ += interval;
+                return frame;
+            }
+        }
+    }
+    unsigned GetWidth () const
+    {
+        return width_;
+    }
+    unsigned GetHeight () const
+    {
+        return height_;
+    }
+    jsp::Camera *GetCamera ()
+    {
+        return &camera_;
+    }
+
+    private:
+    static const unsigned WIDTH_HINT = 320;
+    static const unsigned HEIGHT_HINT = 240;
+    jsp::Camera camera_;
+    std::string device_name_;
+    unsigned width_hint_;
+    unsigned height_hint_;
+    unsigned max_fps_;
+    quint64 next_;
+    unsigned width_;
+    unsigned height_;
+};
+
+/// @brief Generated frames
+///
+/// Draws a moving pattern: diagonal luma bands, a color
+/// gradient, and a bright square that bounces around the
+/// frame.  Frame n is always the same, so runs can be
+/// compared.
+class SyntheticCaptureSource : public CaptureSource
+{
+    public:
+    /// @brief Constructor
+    /// @param width Frame width, which must be even
+    /// @param height Frame height
+    /// @param fps Frames per second, or 0 for as fast as
+    /// possible
+    SyntheticCaptureSource (unsigned width, unsigned height, unsigned fps)
+        : width_ (width)
+        , height_ (height)
+        , pacer_ (fps)
+        , frame_number_ (0)
+    {
+    }
+    void Open ()
+    {
+        if (width_ == 0 || height_ == 0 || width_ % 2 != 0)
+            throw jsp::CameraGeneralException ("Invalid synthetic frame size");
+        frame_.resize (width_ * height_ * 2);
+        frame_number_ = 0;
+    }
+    void Close ()
+    {
+    }
+    void StartCapture ()
+    {
+        pacer_.Reset ();
+    }
+    void StopCapture ()
+    {
+    }
+    const unsigned char *GetFrame (unsigned)
+    {
+        pacer_.Wait ();
+        Draw (frame_number_++);
+        return &frame_[0];
+    }
+    unsigned GetWidth () const
+    {
+        return width_;
+    }
+    unsigned GetHeight () const
+    {
+        return height_;
+    }
+
+    private:
+    /// @brief Draw a frame
+    void Draw (unsigned n)
+    {
+        // The square bounces between the edges
+        const unsigned size = (width_ < height_ ? width_ : height_) / 4;
+        const unsigned sx = Bounce (n * 3, width_ - size);
+        const unsigned sy = Bounce (n * 2, height_ - size);
+        unsigned char *p = &frame_[0];
+        for (unsigned y = 0; y < height_; ++y)
+        {
+            const bool in_rows = y >= sy && y < sy + size;
+            for (unsigned x = 0; x < width_; x += 2)
+            {
+                for (unsigned i = 0; i < 2; ++i)
+                {
+                    const unsigned xi = x + i;
+                    const bool in_square = in_rows && xi >= sx && xi < sx + size;
+                    p[i * 2] = in_square ? 235 : static_cast<unsigned char> (16 + ((xi + y + n * 4) & 0x7f));
+                }
+                p[1] = static_cast<unsigned char> (x * 255 / width_);
+                p[3] = static_cast<unsigned char> (y * 255 / height_);
+                p += 4;
+            }
+        }
+    }
+    /// @brief Move back and forth between 0 and limit
+    static unsigned Bounce (unsigned t, unsigned limit)
+    {
+        if (limit == 0)
+            return 0;
+        const unsigned period = 2 * limit;
+        const unsigned k = t % period;
+        return k <= limit ? k : period - k;
+    }
+
+    unsigned width_;
+    unsigned height_;
+    FramePacer pacer_;
+    unsigned frame_number_;
+    std::vector<unsigned char> frame_;
+};
+
+/// @brief Frames read from a file
+///
+/// Reads either raw YUYV frames, which need the frame size to
+/// be given, or a YUV4MPEG2 (.y4m) file with 4:2:0 or 4:2:2
+/// frames, which is converted to YUYV.  The file is played
+/// in a loop.
+class FileCaptureSource : public CaptureSource
+{
+    public:
+    /// @brief Constructor for a Y4M file
+    /// @param filename The file
+    /// @param fps Frames per second, or 0 to use the rate in
+    /// the file
+    FileCaptureSource (const std::string &filename, unsigned fps)
+        : filename_ (filename)
+        , is_y4m_ (true)
+        , width_ (0)
+        , height_ (0)
+        , chroma_ (Chroma422)
+        , fps_ (fps)
+        , data_offset_ (0)
+    {
+    }
+    /// @brief Constructor for a raw YUYV file
+    /// @param filename The file
+    /// @param width Frame width
+    /// @param height Frame height
+    /// @param fps Frames per second, or 0 for as fast as
+    /// possible
+    FileCaptureSource (const std::string &filename, unsigned width, unsigned height, unsigned fps)
+        : filename_ (filename)
+        , is_y4m_ (false)
+        , width_ (width)
+        , height_ (height)
+        , chroma_ (Chroma422)
+        , fps_ (fps)
+        , data_offset_ (0)
+    {
+    }
+    void Open ()
+    {
+        file_.close ();
+        file_.clear ();
+        file_.open (filename_.c_str (), std::ios::binary);
+        if (!file_)
+            throw jsp::CameraGeneralException (("Could not open " + filename_).c_str ());
+        if (is_y4m_)
+            ReadStreamHeader ();
+        if (width_ == 0 || height_ == 0 || width_ % 2 != 0)
+            throw jsp::CameraGeneralException ("Invalid frame size");
+        data_offset_ = file_.tellg ();
+        // Raw frames are used as they are read
+        buffer_.resize (is_y4m_ ? PlanarSize () : width_ * height_ * 2);
+        if (is_y4m_)
+            frame_.resize (width_ * height_ * 2);
+        pacer_.SetRate (fps_);
+    }
+    void Close ()
+    {
+        file_.close ();
+    }
+    void StartCapture ()
+    {
+        pacer_.Reset ();
+    }
+    void StopCapture ()
+    {
+    }
+    const unsigned char *GetFrame (unsigned)
+    {
+        pacer_.Wait ();
+        if (!ReadFrame ())
+        {
+            // Start over
+            file_.clear ();
+            file_.seekg (data_offset_);
+            if (!ReadFrame ())
+                throw jsp::CameraGeneralException (("No frames in " + filename_).c_str ());
+        }
+        if (!is_y4m_)
+            return &buffer_[0];
+        ToYUYV ();
+        return &frame_[0];
+    }
+    unsigned GetWidth () const
+    {
+        return width_;
+    }
+    unsigned GetHeight () const
+    {
+        return height_;
+    }
+
+    private:
+    enum Chroma
+    {
+        Chroma420,
+        Chroma422,
+    };
+    /// @brief Parse "YUV4MPEG2 W320 H240 F30:1 ..."
+    void ReadStreamHeader ()
+    {
+        std::string line;
+        if (!std::getline (file_, line) || line.compare (0, 9, "YUV4MPEG2") != 0)
+            throw jsp::CameraGeneralException ("Not a YUV4MPEG2 file");
+        std::istringstream s (line.substr (9));
+        std::string tag;
+        chroma_ = Chroma420;
+        while (s >> tag)
+        {
+            const std::string value = tag.substr (1);
+            switch (tag[0])
+            {
+                case 'W':
+                width_ = std::atoi (value.c_str ());
+                break;
+                case 'H':
+                height_ = std::atoi (value.c_str ());
+                break;
+                case 'F':
+                if (fps_ == 0)
+                {
+                    const unsigned num = std::atoi (value.c_str ());
+                    const std::string::size_type colon = value.find (':');
+                    const unsigned den = colon == std::string::npos ? 1 : std::atoi (value.c_str () + colon + 1);
+                    fps_ = den == 0 ? 0 : (num + den / 2) / den;
+                }
+                break;
+                case 'I':
+                if (value != "p" && value != "?")
+                    throw jsp::CameraGeneralException ("Interlaced YUV4MPEG2 files are not supported");
+                break;
+                case 'C':
+                if (value.compare (0, 3, "420") == 0)
+                    chroma_ = Chroma420;
+                else if (value == "422")
+                    chroma_ = Chroma422;
+                else
+                    throw jsp::CameraGeneralException ("Unsupported YUV4MPEG2 colorspace");
+                break;
+                default:
+                break;
+            }
+        }
+    }
+    /// @brief Get the size of a planar frame
+    unsigned PlanarSize () const
+    {
+        const unsigned chroma_rows = chroma_ == Chroma420 ? (height_ + 1) / 2 : height_;
+        return width_ * height_ + 2 * (width_ / 2) * chroma_rows;
+    }
+    /// @brief Read the next frame into the buffer
+    /// @return false at the end of the file
+    bool ReadFrame ()
+    {
+        if (is_y4m_)
+        {
+            // Each frame starts with "FRAME" and optional
+            // parameters
+            std::string line;
+            if (!std::getline (file_, line))
+                return false;
+            if (line.compare (0, 5, "FRAME") != 0)
+                throw jsp::CameraGeneralException ("Corrupt YUV4MPEG2 file");
+        }
+        file_.read (reinterpret_cast<char *> (&buffer_[0]), buffer_.size ());
+        return static_cast<size_t> (file_.gcount ()) == buffer_.size ();
+    }
+    /// @brief Interleave planar Y4M samples as YUYV
+    void ToYUYV ()
+    {
+        const unsigned cw = width_ / 2;
+        const unsigned chroma_rows = chroma_ == Chroma420 ? (height_ + 1) / 2 : height_;
+        const unsigned char *yp = &buffer_[0];
+        const unsigned char *up = yp + width_ * height_;
+        const unsigned char *vp = up + cw * chroma_rows;
+        unsigned char *p = &frame_[0];
+        for (unsigned y = 0; y < height_; ++y)
+        {
+            const unsigned cy = chroma_ == Chroma420 ? y / 2 : y;
+            const unsigned char *ys = yp + y * width_;
+            const unsigned char *us = up + cy * cw;
+            const unsigned char *vs = vp + cy * cw;
+            for (unsigned x = 0; x < cw; ++x)
+            {
+                *p++ = ys[2 * x];
+                *p++ = us[x];
+                *p++ = ys[2 * x + 1];
+                *p++ = vs[x];
+            }
+        }
+    }
+
+    std::string filename_;
+    bool is_y4m_;
+    unsigned width_;
+    unsigned height_;
+    Chroma chroma_;
+    unsigned fps_;
+    std::ifstream file_;
+    std::streampos data_offset_;
+    FramePacer pacer_;
+    std::vector<unsigned char> buffer_;
+    std::vector<unsigned char> frame_;
+};
+
+/// @brief Parse a frame size
+/// @param s The size, as "WxH"
+/// @param w Set to the width
+/// @param h Set to the height
+/// @return false if the size is malformed
+inline bool ParseFrameSize (const std::string &s, unsigned &w, unsigned &h)
+{
+    const std::string::size_type x = s.find ('x');
+    if (x == std::string::npos)
+        return false;
+    w = std::atoi (s.c_str ());
+    h = std::atoi (s.c_str () + x + 1);
+    return w != 0 && h != 0;
+}
+
+/// @brief Make a capture source from a description
+/// @param spec What to capture from
+/// @param width Default frame width, or 0
+/// @param height Default frame height, or 0
+/// @param fps Default frame rate, or 0
+/// @return A new source, which the caller owns
+///
+/// The description is one of:
+///
+///     /dev/video0                a V4L2 device
+///     synthetic[:WxH[@FPS]]      generated frames
+///     file.y4m[@FPS]             a YUV4MPEG2 file
+///     raw:file:WxH[@FPS]         a raw YUYV file
+///
+/// Generated frames default to 320x240 at 30 fps.  A rate of
+/// 0 means as fast as possible.
+///
+/// A size or rate in the description overrides the defaults
+/// passed in.  The width and height must be given together or
+/// not at all.  Cameras take the size as a hint and drop
+/// frames to stay under the rate.  The size of a file is
+/// fixed by the file.
+inline CaptureSource *CreateCaptureSource (const std::string &spec,
+    unsigned width, unsigned height, unsigned fps)
+{
+    if ((width == 0) != (height == 0))
+        throw jsp::CameraGeneralException ("frame width and height must be given together");
+    // Split off the rate
+    std::string s = spec;
+    bool has_fps = fps != 0;
+    const std::string::size_type at = s.rfind ('@');
+    if (at != std::string::npos && s.compare (0, 5, "/dev/") != 0)
+    {
+        fps = std::atoi (s.c_str () + at + 1);
+        has_fps = true;
+        s = s.substr (0, at);
+    }
+    unsigned w = width ? width : 320;
+    unsigned h = height ? height : 240;
+    if (s.compare (0, 9, "synthetic") == 0)
+    {
+        if (s.size () > 10 && !ParseFrameSize (s.substr (10), w, h))
+            throw jsp::CameraGeneralException ("usage: synthetic[:WxH[@FPS]]");
+        return new SyntheticCaptureSource (w, h, has_fps ? fps : 30);
+    }
+    if (s.compare (0, 4, "raw:") == 0)
+    {
+        const std::string::size_type colon = s.rfind (':');
+        if (colon <= 4 || !ParseFrameSize (s.substr (colon + 1), w, h))
+            throw jsp::CameraGeneralException ("usage: raw:FILE:WxH[@FPS]");
+        return new FileCaptureSource (s.substr (4, colon - 4), w, h, fps);
+    }
+    if (s.size () > 4 && s.compare (s.size () - 4, 4, ".y4m") == 0)
+        return new FileCaptureSource (s, fps);
+    return new V4L2CaptureSource (spec, width, height, fps);
+}
+
+/// @brief Make a capture source from a description
+/// @param spec What to capture from
+/// @return A new source, which the caller owns
+inline CaptureSource *CreateCaptureSource (const std::string &spec)
+{
+    return CreateCaptureSource (spec, 0, 0, 0);
+}
+
+} // namespace flying_dragon
+
+#endif // CAPTURE_SOURCE_H
@@ -0,0 +1,214 @@
+// Capture Thread
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 11:40:52 CDT 2026
+
+#ifndef CAPTURE_THREAD_H
+#define CAPTURE_THREAD_H
+
+#include "camera.h"
+#include "capture_source.h"
+#include "clock.h"
+#include "video_frame.h"
+#include "yuyv.h"
+#include <cassert>
+#include <exception>
+#include <QByteArray>
+#include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QString>
+#include <QThread>
+
+namespace flying_dragon
+{
+
+/// @brief A frame that has been captured and converted
+struct CapturedFrame
+{
+    /// @brief The frame and its YV12 planes
+    VideoFrame frame;
+    /// @brief A thumbnail of the frame
+    QImage icon;
+};
+
+/// @brief Capture frames on their own thread
+///
+/// Waits on the source, converts each frame, and puts it in a
+/// bounded queue.  The GUI thread is told about new frames
+/// through a queued signal, so a slow camera never stalls the
+/// event loop.  When the queue is full the oldest frame is
+/// dropped.
+class CaptureThread : public QThread
+{
+    Q_OBJECT
+
+    signals:
+    /// @brief A frame has been queued
+    ///
+    /// Emitted from the capture thread.  Call TakeFrames() to
+    /// get it.
+    void FrameReady ();
+    /// @brief Capturing failed
+    /// @param what Why it failed
+    ///
+    /// Emitted from the capture thread, which then exits.
+    void CaptureError (const QString &what);
+
+    public:
+    /// @brief Constructor
+    /// @param icon_size Width and height of the thumbnails
+    CaptureThread (int icon_size)
+        : source_ (0)
+        , icon_size_ (icon_size)
+        , width_ (0)
+        , height_ (0)
+        , stopping_ (false)
+        , dropped_ (0)
+        , sequence_ (0)
+    {
+    }
+    /// @brief Destructor
+    ~CaptureThread ()
+    {
+        Stop ();
+    }
+    /// @brief Start capturing
+    /// @param source The source to capture from
+    ///
+    /// The source must already be capturing, and must outlive
+    /// the capture.
+    void Start (CaptureSource *source)
+    {
+        assert (source);
+        assert (!isRunning ());
+        source_ = source;
+        width_ = source->GetWidth ();
+        height_ = source->GetHeight ();
+        {
+            QMutexLocker lock (&mutex_);
+            stopping_ = false;
+            queue_.clear ();
+        }
+        start ();
+    }
+    /// @brief Stop capturing and wait for the thread to exit
+    ///
+    /// If the source is stuck this can take as long as the
+    /// capture timeout.
+    void Stop ()
+    {
+        {
+            QMutexLocker lock (&mutex_);
+            stopping_ = true;
+        }
+        wait ();
+    }
+    /// @brief Take all of the queued frames, oldest first
+    QQueue<CapturedFrame> TakeFrames ()
+    {
+        QMutexLocker lock (&mutex_);
+        QQueue<CapturedFrame> frames = queue_;
+        queue_.clear ();
+        return frames;
+    }
+    /// @brief Get the number of frames dropped because the
+    /// queue was full
+    unsigned GetDropped ()
+    {
+        QMutexLocker lock (&mutex_);
+        return dropped_;
+    }
+
+    protected:
+    /// @brief QThread override
+    void run ()
+    {
+        try
+        {
+            while (!IsStopping ())
+            {
+                const unsigned char *frame = source_->GetFrame (TIMEOUT_SECS);
+                const quint64 capture_time = MonotonicMicroseconds ();
+                if (IsStopping ())
+                    break;
+                Push (Convert (frame, sequence_++, capture_time));
+                emit FrameReady ();
+            }
+        }
+        catch (const std::exception &e)
+        {
+            emit CaptureError (QString (e.what ()));
+        }
+        catch (...)
+        {
+            emit CaptureError (QString ("unknown capture error"));
+        }
+    }
+
+    private:
+    bool IsStopping ()
+    {
+        QMutexLocker lock (&mutex_);
+        return stopping_;
+    }
+    /// @brief Convert a YUYV frame to RGB32, planar yuv,
+    /// and an icon in one pass
+    ///
+    /// The buffers get handed to another thread, so each frame
+    /// gets its own.
+    CapturedFrame Convert (const unsigned char *frame, quint32 sequence, quint64 capture_time) const
+    {
+        QImage image (width_, height_, QImage::Format_RGB32);
+        QByteArray yuv;
+        yuv.resize (VideoFrame::YUV420Size (width_, height_));
+        unsigned char *y = reinterpret_cast<unsigned char *> (yuv.data ());
+        unsigned char *u = y + width_ * height_;
+        unsigned char *v = u + (width_ / 2) * (height_ / 2);
+        CapturedFrame f;
+        f.icon = QImage (icon_size_, icon_size_, QImage::Format_RGB32);
+        YUYV2RGB32 (frame,
+            width_,
+            height_,
+            image.bits (),
+            y,
+            u,
+            v,
+            f.icon.bits (),
+            icon_size_,
+            icon_size_);
+        f.frame = VideoFrame (image, yuv, sequence, capture_time);
+        return f;
+    }
+    void Push (const CapturedFrame &f)
+    {
+        QMutexLocker lock (&mutex_);
+        while (queue_.size () >= MAX_QUEUED)
+        {
+            queue_.dequeue ();
+            ++dropped_;
+        }
+        queue_.enqueue (f);
+    }
+
+    static const unsigned TIMEOUT_SECS = 3;
+    static const int MAX_QUEUED = 3;
+    CaptureSource *source_;
+    int icon_size_;
+    unsigned width_;
+    unsigned height_;
+    QMutex mutex_;
+    bool stopping_;
+    unsigned dropped_;
+    // Only used on the capture thread
+    quint32 sequence_;
+    QQueue<CapturedFrame> queue_;
+};
+
+} // namespace flying_dragon
+
+#endif // CAPTURE_THREAD_H
@@ -0,0 +1,34 @@
+// Clock Functions
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 12:21:07 CDT 2026
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <QtGlobal>
+#include <time.h>
+
+namespace flying_dragon
+{
+
+/// @brief Get the current time from a monotonic clock
+/// @return Microseconds since an arbitrary start point
+///
+/// The clock never jumps when the wall clock is set, so
+/// differences between two readings on the same host are
+/// always meaningful.  Readings from different hosts can not
+/// be compared.
+inline quint64 MonotonicMicroseconds ()
+{
+    timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return static_cast<quint64> (ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+} // namespace flying_dragon
+
+#endif // CLOCK_H
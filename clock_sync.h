@@ -0,0 +1,195 @@
+// Clock Synchronization
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 16:11:52 CDT 2026
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <QVector>
+#include <QtGlobal>
+
+namespace flying_dragon
+{
+
+/// @brief Estimate the offset of a peer's clock from ours
+///
+/// Works like NTP.  Each exchange gives four times: when we
+/// sent a message (t0), when the peer received it (t1), when
+/// the peer sent its reply (t2), and when the reply arrived
+/// (t3).  Assuming the path is equally long both ways, the
+/// peer's clock is ahead of ours by
+///
+///     ((t1 - t0) + (t2 - t3)) / 2
+///
+/// Queueing makes paths unequal, so only the exchange with the
+/// shortest round trip in each interval is kept.  The drift
+/// between the clocks is the slope of a least squares line
+/// through the kept offsets.
+///
+/// t0 and t3 are MonotonicMicroseconds() here, t1 and t2 are
+/// MonotonicMicroseconds() on the peer.
+class ClockSync
+{
+    public:
+    /// @brief Constructor
+    ClockSync ()
+    {
+        Reset ();
+    }
+    /// @brief Forget all exchanges
+    void Reset ()
+    {
+        history_.clear ();
+        best_time_ = 0;
+        best_offset_ = 0;
+        best_delay_ = 0;
+        has_best_ = false;
+        interval_start_ = 0;
+        offset_ = 0.0;
+        drift_ = 0.0;
+        base_time_ = 0;
+    }
+    /// @brief Add an exchange
+    /// @param t0 When we sent the message
+    /// @param t1 When the peer received it
+    /// @param t2 When the peer sent the reply
+    /// @param t3 When the reply arrived
+    void Add (quint64 t0, quint64 t1, quint64 t2, quint64 t3)
+    {
+        if (t3 < t0 || t2 < t1)
+            return;
+        const quint64 elapsed = t3 - t0;
+        const quint64 held = t2 - t1;
+        if (held > elapsed)
+            return;
+        const quint64 delay = elapsed - held;
+        const qint64 offset = (static_cast<qint64> (t1 - t0)
+            + static_cast<qint64> (t2 - t3)) / 2;
+
+        // Close the interval
+        if (has_best_ && t3 - interval_start_ > INTERVAL_USECS)
+        {
+            Sample s;
+            s.time = best_time_;
+            s.offset = best_offset_;
+            history_.push_back (s);
+            if (history_.size () > HISTORY_SIZE)
+                history_.erase (history_.begin ());
+            has_best_ = false;
+        }
+        if (!has_best_)
+            interval_start_ = t3;
+        // Keep the shortest round trip
+        if (!has_best_ || delay <= best_delay_)
+        {
+            best_time_ = t3;
+            best_offset_ = offset;
+            best_delay_ = delay;
+            has_best_ = true;
+        }
+        Update ();
+    }
+    /// @brief Determine if there is an estimate yet
+    bool IsValid () const
+    {
+        return has_best_ || !history_.isEmpty ();
+    }
+    /// @brief Get how far the peer's clock is ahead of ours
+    /// @param now Our current time
+    /// @return The offset in microseconds
+    qint64 GetOffset (quint64 now) const
+    {
+        const double t = static_cast<double> (now) - static_cast<double> (base_time_);
+        return static_cast<qint64> (offset_ + drift_ * t);
+    }
+    /// @brief Get how fast the peer's clock runs compared to
+    /// ours
+    /// @return The drift in parts per million
+    double GetDrift () const
+    {
+        return drift_ * 1000000.0;
+    }
+    /// @brief Get the shortest round trip in the current
+    /// interval
+    /// @return The round trip in microseconds, leaving out the
+    /// time the peer held the reply
+    quint64 GetRoundTripTime () const
+    {
+        return best_delay_;
+    }
+    /// @brief Convert a time on the peer's clock to ours
+    /// @param peer_time The peer's time
+    /// @param now Our current time
+    quint64 ToLocal (quint64 peer_time, quint64 now) const
+    {
+        return peer_time - GetOffset (now);
+    }
+
+    private:
+    struct Sample
+    {
+        quint64 time;
+        qint64 offset;
+    };
+    /// @brief Fit the offsets
+    void Update ()
+    {
+        // Fit the past intervals and the current one
+        QVector<Sample> samples = history_;
+        Sample s;
+        s.time = best_time_;
+        s.offset = best_offset_;
+        samples.push_back (s);
+        base_time_ = samples[0].time;
+        if (samples.size () < MIN_DRIFT_SAMPLES)
+        {
+            offset_ = s.offset;
+            drift_ = 0.0;
+            base_time_ = s.time;
+            return;
+        }
+        // Least squares, relative to the first sample to keep
+        // the sums small
+        const int n = samples.size ();
+        double st = 0.0;
+        double so = 0.0;
+        for (int i = 0; i < n; ++i)
+        {
+            st += samples[i].time - base_time_;
+            so += samples[i].offset;
+        }
+        const double mt = st / n;
+        const double mo = so / n;
+        double stt = 0.0;
+        double sto = 0.0;
+        for (int i = 0; i < n; ++i)
+        {
+            const double dt = samples[i].time - base_time_ - mt;
+            stt += dt * dt;
+            sto += dt * (samples[i].offset - mo);
+        }
+        drift_ = stt > 0.0 ? sto / stt : 0.0;
+        offset_ = mo - drift_ * mt;
+    }
+
+    static const quint64 INTERVAL_USECS = 2000000;
+    static const int HISTORY_SIZE = 32;
+    static const int MIN_DRIFT_SAMPLES = 4;
+    QVector<Sample> history_;
+    quint64 best_time_;
+    qint64 best_offset_;
+    quint64 best_delay_;
+    bool has_best_;
+    quint64 interval_start_;
+    double offset_;
+    double drift_;
+    quint64 base_time_;
+};
+
+} // namespace flying_dragon
+
+#endif // CLOCK_SYNC_H
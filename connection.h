@@ -11,13 +11,19 @@
 
 #include "connection_exceptions.h"
 #include "frame.h"
+#include "fixation_predictor.h"
+#include "frame_cache.h"
 #include "message_manager.h"
+#include "rate_controller.h"
+#include "video_frame.h"
 #include <QHostAddress>
 #include <QIcon>
 #include <QImage>
 #include <QPixmap>
+#include <QSharedPointer>
 #include <QString>
 #include <QTcpSocket>
+#include <QTimer>
 #include <QVariant>
 #include <cassert>
 
@@ -59,9 +65,27 @@ class Connection : public QTcpSocket
         , is_foveated_ (false)
         , fx_ (0)
         , fy_ (0)
+        , e2_ (Frame::DEFAULT_E2)
+        , has_fixation_ (false)
+        , foveate_refused_ (false)
+        , auto_fx_ (0)
+        , auto_fy_ (0)
+        , has_auto_fixation_ (false)
+        , frame_encoding_ (Frame::EncodingRGB32)
     {
         QObject::connect (this, SIGNAL(error(QAbstractSocket::SocketError)),
             this, SLOT(HandleError(QAbstractSocket::SocketError)));
+        QObject::connect (&message_manager_, SIGNAL(ReceivedAck(quint64)),
+            this, SLOT(ReceivedAck(quint64)));
+        QObject::connect (&message_manager_, SIGNAL(FrameWritten(quint64,int)),
+            this, SLOT(FrameWritten(quint64,int)));
+        // Queued, because the message manager may still be
+        // writing when it becomes ready
+        QObject::connect (&message_manager_, SIGNAL(ReadyForFrame()),
+            this, SLOT(SendPendingFrame()), Qt::QueuedConnection);
+        pace_timer_.setSingleShot (true);
+        QObject::connect (&pace_timer_, SIGNAL(timeout()),
+            this, SLOT(SendPendingFrame()));
     }
     /// @brief Destructor
     virtual ~Connection ()
@@ -128,38 +152,139 @@ class Connection : public QTcpSocket
     {
         message_manager_.SendIcon (icon);
     }
+    /// @brief Get the encoding the peer asked for
+    ///
+    /// This is the encoding used for unfoveated frames.
+    Frame::Encoding GetFrameEncoding () const { return frame_encoding_; }
+    /// @brief Set the encoding used until the peer asks for
+    /// another one
+    void SetFrameEncoding (Frame::Encoding encoding)
+    {
+        frame_encoding_ = encoding;
+    }
     /// @brief Send a frame message to the peer
-    /// @param frame The frame
-    void SendFrame (const QImage &frame)
+    /// @param frames The encodings of the frame, shared with
+    /// the other connections
+    ///
+    /// The frame goes into a one frame pending slot, replacing
+    /// any frame that has not started going out yet, and is
+    /// encoded and sent as soon as the previous frame has left
+    /// and the rate controller says the link has room.  The
+    /// peer always gets the newest frame, at most one frame
+    /// ever waits, and frames that are replaced are never
+    /// encoded.
+    ///
+    /// A foveated frame is foveated about where the viewer
+    /// is predicted to look when it is displayed, about one
+    /// round trip after the newest fixation arrived.  The
+    /// fovea is widened when the prediction is unreliable.
+    ///
+    /// A peer that has never sent a fixation is sent frames
+    /// foveated about the automatic fixation, if there is one,
+    /// unless it has asked for foveation to be turned off.
+    /// Once a peer sends a fixation, its frames are foveated
+    /// about its own fixations from then on.
+    ///
+    /// The frame is only encoded if no other connection has
+    /// already asked the cache for the same encoding.
+    void SendFrame (const QSharedPointer<FrameCache> &frames)
     {
-        // Encode the frame
-        Frame f;
-        if (is_foveated_)
-            f.Encode (frame, fx_, fy_, e2_);
-        else
-            f.Encode (frame);
-        message_manager_.SendFrame (f);
+        pending_frames_ = frames;
+        SendPendingFrame ();
+    }
+    /// @brief Set the fixation used for peers that do not
+    /// send their own
+    /// @param x The x coord in frame pixels
+    /// @param y The y coord in frame pixels
+    void SetAutoFixation (int x, int y)
+    {
+        auto_fx_ = x;
+        auto_fy_ = y;
+        has_auto_fixation_ = true;
+    }
+    /// @brief Stop using an automatic fixation
+    void ClearAutoFixation ()
+    {
+        has_auto_fixation_ = false;
+    }
+    /// @brief Get the frame rate controller
+    const RateController &GetRateController () const
+    {
+        return rate_controller_;
     }
     /// @brief Send a fixation point to the peer
     /// @param x The x coord
     /// @param y The y coord
     /// @param e2 e2
+    ///
+    /// Fixations are coalesced to at most the fixation rate.
     void SendFixation (qreal x, qreal y, qreal e2)
     {
         message_manager_.SendFixation (x, y, e2);
     }
+    /// @brief Set the most fixations sent per second
+    /// @param rate Fixations per second
+    void SetFixationRate (int rate)
+    {
+        message_manager_.SetFixationRate (rate);
+    }
     /// @brief Get message latency
-    /// @return The latency in ms
+    /// @return The median round trip time in ms
     ///
-    /// When a message is created, it is timestamped.  When
-    /// a peer receives a message it creates an ack message
-    /// and sends it back with the original timestamp.  This
-    /// function returns the difference between the current
-    /// time and the last ack message's timestamp.
+    /// When a message is sent, its id and send time are
+    /// recorded.  When a peer receives a message it sends
+    /// back an ack carrying the message's id.  The round trip
+    /// time is the difference between the time the ack
+    /// arrived and the recorded send time.
     int GetMessageLatency () const
     {
         return message_manager_.GetMessageLatency ();
     }
+    /// @brief Get round trip time statistics
+    /// @return Min, mean, median, and 99th percentile of
+    /// recent round trip times, in microseconds
+    const LatencyStats &GetLatencyStats () const
+    {
+        return message_manager_.GetLatencyStats ();
+    }
+    /// @brief Get one way delay statistics to the peer
+    /// @return Min, mean, median, and 99th percentile of
+    /// recent delays, in microseconds
+    ///
+    /// One way delays are measured against an estimate of the
+    /// peer's clock, which is made from the timestamps in
+    /// messages and their acks.
+    const LatencyStats &GetUplinkStats () const
+    {
+        return message_manager_.GetUplinkStats ();
+    }
+    /// @brief Get one way delay statistics from the peer
+    /// @return Min, mean, median, and 99th percentile of
+    /// recent delays, in microseconds
+    const LatencyStats &GetDownlinkStats () const
+    {
+        return message_manager_.GetDownlinkStats ();
+    }
+    /// @brief Get the estimate of the peer's clock
+    const ClockSync &GetClockSync () const
+    {
+        return message_manager_.GetClockSync ();
+    }
+    /// @brief Get the stage times of frames received from the
+    /// peer
+    ///
+    /// Call Decoded() and Painted() on it as each received
+    /// frame is displayed.
+    FrameLatency &GetFrameLatency ()
+    {
+        return message_manager_.GetFrameLatency ();
+    }
+    /// @brief Get the stage times of frames received from the
+    /// peer
+    const FrameLatency &GetFrameLatency () const
+    {
+        return message_manager_.GetFrameLatency ();
+    }
 
     public slots:
     void ReceivedStreamCommand (bool state)
@@ -177,6 +302,7 @@ class Connection : public QTcpSocket
     {
         qDebug() << "received foveate command" << state;
         is_foveated_ = state;
+        foveate_refused_ = !state;
         emit StateChanged ();
     }
     void SendFoveateCommand (bool state)
@@ -184,6 +310,19 @@ class Connection : public QTcpSocket
         qDebug() << "sending foveate command" << state;
         message_manager_.SendFoveateCommand (state);
     }
+    void ReceivedFormatCommand (int encoding)
+    {
+        // Only full resolution encodings can be requested
+        switch (encoding)
+        {
+            case Frame::EncodingRGB32:
+            case Frame::EncodingYUV420:
+            frame_encoding_ = static_cast<Frame::Encoding> (encoding);
+            break;
+            default:
+            frame_encoding_ = Frame::EncodingRGB32;
+        }
+    }
 
     protected slots:
     /// @brief Change to a different state
@@ -207,6 +346,11 @@ class Connection : public QTcpSocket
     void Connected ()
     {
         ChangeState (StateConnected);
+        rate_controller_.Reset ();
+        fixation_predictor_.Reset ();
+        has_fixation_ = false;
+        foveate_refused_ = false;
+        pending_frames_.clear ();
         connect (&message_manager_, SIGNAL(ReceivedStreamCommand(bool)),
             this, SLOT(ReceivedStreamCommand(bool)));
         connect (&message_manager_, SIGNAL(ReceivedFoveateCommand(bool)),
@@ -217,6 +361,11 @@ class Connection : public QTcpSocket
             this, SIGNAL(ReceivedFrame(const Frame &)));
         connect (&message_manager_, SIGNAL(ReceivedFixation(int,int,int)),
             this, SLOT(ReceivedFixation(int,int,int)));
+        connect (&message_manager_, SIGNAL(ReceivedFormatCommand(int)),
+            this, SLOT(ReceivedFormatCommand(int)));
+        // Ask the peer for planar frames, which we convert
+        // to RGB when they are displayed
+        message_manager_.SendFormatCommand (Frame::EncodingYUV420);
     }
 
 
@@ -238,12 +387,45 @@ class Connection : public QTcpSocket
                 throw ConnectionGeneralException (errorString ().toStdString ().c_str ());
         }
     }
+    void ReceivedAck (quint64 id)
+    {
+        rate_controller_.Acked (id, MonotonicMicroseconds ());
+        // The ack may have opened the window
+        SendPendingFrame ();
+    }
+    /// @brief Send the pending frame if the link has room
+    void SendPendingFrame ()
+    {
+        if (pending_frames_.isNull () || !message_manager_.IsReadyForFrame ())
+            return;
+        const quint64 now = MonotonicMicroseconds ();
+        if (!rate_controller_.ReadyToSend (now))
+        {
+            // Come back when pacing allows.  If the window is
+            // full instead, an ack will bring us back.
+            const quint64 next = rate_controller_.GetNextSendTime ();
+            if (next > now && !pace_timer_.isActive ())
+                pace_timer_.start (static_cast<int> ((next - now + 999) / 1000));
+            return;
+        }
+        // Encode as late as possible, about the newest fixation
+        message_manager_.SendFrame (GetFrame (*pending_frames_));
+        pending_frames_.clear ();
+    }
+    /// @brief Start timing a frame once all of it has been
+    /// written
+    void FrameWritten (quint64 id, int bytes)
+    {
+        rate_controller_.Sent (id, bytes, MonotonicMicroseconds ());
+    }
     void ReceivedFixation (int x, int y, int e2)
     {
-        qDebug() << "received fixation at" << x << " " << y << " " << e2;
+        //qDebug() << "received fixation at" << x << " " << y << " " << e2;
         fx_ = x;
         fy_ = y;
         e2_ = e2;
+        has_fixation_ = true;
+        fixation_predictor_.Add (x, y, MonotonicMicroseconds ());
     }
 
     protected:
@@ -253,6 +435,25 @@ class Connection : public QTcpSocket
     MessageManager message_manager_;
 
     private:
+    /// @brief Encode a frame the way the peer wants it
+    /// @param frames The encodings of the frame
+    Frame GetFrame (FrameCache &frames)
+    {
+        if (has_auto_fixation_ && !has_fixation_ && !foveate_refused_)
+            return frames.Get (auto_fx_, auto_fy_, rate_controller_.AdjustE2 (e2_));
+        if (is_foveated_)
+        {
+            const quint64 display_time = MonotonicMicroseconds ()
+                + rate_controller_.GetRoundTripTime ();
+            int x = fx_;
+            int y = fy_;
+            fixation_predictor_.Predict (display_time, x, y);
+            const int e2 = fixation_predictor_.WidenE2 (e2_, display_time);
+            return frames.Get (x, y, rate_controller_.AdjustE2 (e2));
+        }
+        return frames.Get (frame_encoding_);
+    }
+
     unsigned id_;
     State state_;
     bool is_streaming_;
@@ -260,6 +461,16 @@ class Connection : public QTcpSocket
     int fx_;
     int fy_;
     int e2_;
+    bool has_fixation_;
+    bool foveate_refused_;
+    int auto_fx_;
+    int auto_fy_;
+    bool has_auto_fixation_;
+    Frame::Encoding frame_encoding_;
+    RateController rate_controller_;
+    FixationPredictor fixation_predictor_;
+    QSharedPointer<FrameCache> pending_frames_;
+    QTimer pace_timer_;
     static const qint64 MAX_MESSAGE_SIZE = 1024 * 1024 * 16;
 };
 
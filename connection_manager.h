@@ -12,8 +12,11 @@
 #include "connection.h"
 #include <QIcon>
 //#include <QMap>
+#include <QFile>
 #include <QHash>
+#include <QList>
 #include <QObject>
+#include <QSharedPointer>
 #include <QTcpSocket>
 #include <cassert>
 
@@ -37,6 +40,9 @@ class ConnectionManager : public QObject
     /// @brief Constructor
     ConnectionManager ()
         : current_connection_id_ (0)
+        , default_encoding_ (Frame::EncodingRGB32)
+        , default_foveated_ (false)
+        , fixation_rate_ (0)
     {
     }
     /// @brief Get a new connection ID
@@ -65,11 +71,56 @@ class ConnectionManager : public QObject
             new ServerConnection (this, GetNewID (), socket_descriptor);
         Add (connection);
     }
+    /// @brief Log the stage times of every frame displayed
+    /// @param filename The log file
+    /// @return false if the file could not be opened
+    ///
+    /// Connections made from now on write to the log.  See
+    /// FrameLatency for the format.
+    bool SetLatencyLog (const QString &filename)
+    {
+        latency_log_.close ();
+        latency_log_.setFileName (filename);
+        if (!latency_log_.open (QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+        latency_log_.write (FrameLatency::GetLogHeader ());
+        return true;
+    }
+    /// @brief Set how frames are sent to new connections
+    /// @param encoding The full resolution encoding
+    /// @param foveated Whether frames are foveated
+    ///
+    /// Peers can still ask for something else.
+    void SetDefaultEncoding (Frame::Encoding encoding, bool foveated)
+    {
+        default_encoding_ = encoding;
+        default_foveated_ = foveated;
+    }
+    /// @brief Set the most fixations each connection sends
+    /// per second
+    /// @param rate Fixations per second, or 0 for the
+    /// connection's default
+    void SetFixationRate (int rate)
+    {
+        assert (rate >= 0);
+        fixation_rate_ = rate;
+        if (fixation_rate_ == 0)
+            return;
+        Connection *c;
+        foreach (c, connections_)
+            c->SetFixationRate (fixation_rate_);
+    }
     /// @brief Add a connection
     /// @param connection The connection to add
     void Add (Connection *connection)
     {
         assert (connection);
+        connection->SetFrameEncoding (default_encoding_);
+        connection->SetFoveated (default_foveated_);
+        if (fixation_rate_ != 0)
+            connection->SetFixationRate (fixation_rate_);
+        if (latency_log_.isOpen ())
+            connection->GetFrameLatency ().SetLog (&latency_log_, connection->GetID ());
         connections_[connection->GetID ()] = connection;
         emit Added (connection);
     }
@@ -86,6 +137,20 @@ class ConnectionManager : public QObject
         connections_.remove (id);
         emit Removed (id);
     }
+    /// @brief Remove the connections whose peers have gone
+    /// away
+    void RemoveDisconnected ()
+    {
+        QList<unsigned> gone;
+        Connection *c;
+        foreach (c, connections_)
+            if (c->GetState () == Connection::StateDisconnected ||
+                c->state () == QAbstractSocket::UnconnectedState)
+                gone.append (c->GetID ());
+        unsigned id;
+        foreach (id, gone)
+            Remove (id);
+    }
     /// @brief Get the total number of connections
     int Total () const
     {
@@ -110,18 +175,49 @@ class ConnectionManager : public QObject
                 c->SendIcon (icon);
     }
     /// @brief A new frame is ready to send
-    void NewFrame (const QImage &frame)
+    ///
+    /// Connections that want the same encoding share a single
+    /// encoded payload.  Each connection encodes the frame when
+    /// it is ready to send it, so the cache is kept until the
+    /// last connection is done with it.
+    void NewFrame (const VideoFrame &frame)
     {
+        QSharedPointer<FrameCache> frames (new FrameCache (frame));
         Connection *c;
         foreach (c, connections_)
             if (c->GetState () == Connection::StateConnected &&
                 c->GetStreaming ())
-                c->SendFrame (frame);
+                c->SendFrame (frames);
+    }
+
+    /// @brief A new automatic fixation has been found
+    /// @param x The x coord in frame pixels
+    /// @param y The y coord in frame pixels
+    ///
+    /// Frames for peers that do not send fixations are
+    /// foveated about it, unless the peer has turned
+    /// foveation off.
+    void AutoFixation (int x, int y)
+    {
+        Connection *c;
+        foreach (c, connections_)
+            c->SetAutoFixation (x, y);
+    }
+    /// @brief Stop using automatic fixations
+    void ClearAutoFixation ()
+    {
+        Connection *c;
+        foreach (c, connections_)
+            c->ClearAutoFixation ();
     }
 
     private:
     QHash<unsigned, Connection *> connections_;
     unsigned current_connection_id_;
+    QFile latency_log_;
+    Frame::Encoding default_encoding_;
+    bool default_foveated_;
+    int fixation_rate_;
 };
 
 } // namespace flying_dragon
@@ -10,14 +10,17 @@
 #define CONNECTION_MANAGER_WIDGET_H
 
 #include "camera_dialog.h"
+#include "clock.h"
 #include "connection_manager.h"
 #include "frame.h"
+#include "frame_latency.h"
 #include <QAction>
 #include <QBrush>
 #include <QColor>
 #include <QGridLayout>
 #include <QObject>
 #include <QPushButton>
+#include <QTimer>
 #include <QTreeWidgetItem>
 #include <QTreeWidget>
 #include <QWidget>
@@ -50,6 +53,10 @@ class ConnectionManagerWidget : public QWidget
             this, SLOT(CloseNetworkCameraDialog()));
         QObject::connect (&network_camera_dialog_, SIGNAL(NewFixation(int,int,int)),
             this, SLOT(NewFixation(int,int,int)));
+        QObject::connect (&network_camera_dialog_, SIGNAL(Painted()),
+            this, SLOT(FramePainted()));
+        QObject::connect (&latency_timer_, SIGNAL(timeout()),
+            this, SLOT(UpdateLatencyText()));
     }
 
     private slots:
@@ -108,9 +115,22 @@ class ConnectionManagerWidget : public QWidget
     }
     void ReceivedFrame (const Frame &frame)
     {
+        Connection *connection = qobject_cast<Connection *> (QObject::sender ());
         QImage image = frame.Decode ();
+        if (connection)
+            connection->GetFrameLatency ().Decoded (MonotonicMicroseconds ());
         network_camera_dialog_.NewFrame (image);
     }
+    void FramePainted ()
+    {
+        if (current_streaming_connection_)
+            current_streaming_connection_->GetFrameLatency ().Painted (MonotonicMicroseconds ());
+    }
+    void UpdateLatencyText ()
+    {
+        if (current_streaming_connection_)
+            UpdateLatencyText (current_streaming_connection_, FindItem (current_streaming_connection_));
+    }
     void on_ItemWidget_itemClicked (QTreeWidgetItem *item, int column)
     {
         unsigned id = item->data (0, Qt::UserRole).toUInt ();
@@ -161,6 +181,7 @@ class ConnectionManagerWidget : public QWidget
         server_labels << "State";
         server_labels << "Streaming";
         server_labels << "Foveated";
+        server_labels << "Latency";
         server_connections_->setHeaderLabels (server_labels);
         server_connections_->setRootIsDecorated (false);
         server_connections_->hideColumn (0);
@@ -175,6 +196,7 @@ class ConnectionManagerWidget : public QWidget
         client_labels << "State";
         client_labels << "Streaming";
         client_labels << "Foveated";
+        client_labels << "Latency";
         client_connections_->setHeaderLabels (client_labels);
         client_connections_->setRootIsDecorated (false);
         client_connections_->hideColumn (0);
@@ -249,6 +271,40 @@ class ConnectionManagerWidget : public QWidget
             item->setText (5, "OFF");
             item->setCheckState (5, Qt::Unchecked);
         }
+        UpdateLatencyText (connection, item);
+    }
+    /// @brief Show the latency of the frames displayed
+    ///
+    /// The column shows the median and 99th percentile of the
+    /// capture to paint time.  The tooltip breaks them down by
+    /// stage.
+    void UpdateLatencyText (const Connection *connection, QTreeWidgetItem *item)
+    {
+        const FrameLatency &latency = connection->GetFrameLatency ();
+        const LatencyStats &total = latency.GetStats (FrameLatency::StageTotal);
+        if (total.GetSize () == 0)
+        {
+            item->setText (6, "");
+            item->setToolTip (6, "");
+            return;
+        }
+        item->setText (6, FormatStats (total));
+        QString tip;
+        for (int i = 0; i < FrameLatency::STAGES; ++i)
+        {
+            const FrameLatency::Stage stage = static_cast<FrameLatency::Stage> (i);
+            if (i != 0)
+                tip += "\n";
+            tip += FrameLatency::GetName (stage) + ": " + FormatStats (latency.GetStats (stage));
+        }
+        item->setToolTip (6, tip);
+    }
+    /// @brief Format the median and 99th percentile in ms
+    static QString FormatStats (const LatencyStats &stats)
+    {
+        return QString ("%1 / %2 ms")
+            .arg (stats.GetP50 () / 1000.0, 0, 'f', 1)
+            .arg (stats.GetP99 () / 1000.0, 0, 'f', 1);
     }
     void CloseCurrent ()
     {
@@ -258,6 +314,7 @@ class ConnectionManagerWidget : public QWidget
             current_streaming_connection_->SendStreamCommand (false);
             current_streaming_connection_ = 0;
             network_camera_dialog_.hide ();
+            latency_timer_.stop ();
         }
     }
     void OpenNew (Connection *connection)
@@ -268,12 +325,15 @@ class ConnectionManagerWidget : public QWidget
         network_camera_dialog_.setWindowTitle (current_streaming_connection_->GetName ());
         network_camera_dialog_.setObjectName (current_streaming_connection_->GetName ());
         network_camera_dialog_.show ();
+        latency_timer_.start (LATENCY_UPDATE_MSECS);
     }
     ConnectionManager *connection_manager_;
     QTreeWidget *server_connections_;
     QTreeWidget *client_connections_;
     Connection *current_streaming_connection_;
     CameraDialog network_camera_dialog_;
+    static const int LATENCY_UPDATE_MSECS = 1000;
+    QTimer latency_timer_;
 };
 
 } // namespace flying_dragon
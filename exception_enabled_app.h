@@ -10,6 +10,7 @@
 #define EXCEPTION_ENABLED_APP_H
 
 #include <QApplication>
+#include <QCoreApplication>
 #include <iostream>
 #include <stdexcept>
 
@@ -53,6 +54,42 @@ class ExceptionEnabledApplication : public QApplication
     private:
 };
 
+/// @brief A Qt application without a GUI that can throw
+class ExceptionEnabledCoreApplication : public QCoreApplication
+{
+    Q_OBJECT
+
+    public:
+    /// @brief Constructor
+    /// @param argc Number of args
+    /// @param argv The args
+    ExceptionEnabledCoreApplication (int &argc, char *argv[])
+        : QCoreApplication (argc, argv)
+    {
+    }
+    /// @brief QCoreApplication override
+    bool notify (QObject *o, QEvent *e)
+    {
+        try
+        {
+            return QCoreApplication::notify (o, e);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what () << std::endl;
+            QCoreApplication::quit ();
+            // You can't rethrow after you quit()
+        }
+        catch (...)
+        {
+            std::cerr << "unknown exception" << std::endl;
+            QCoreApplication::quit ();
+            // You can't rethrow after you quit()
+        }
+        return true;
+    }
+};
+
 } // namespace flying_dragon
 
 #endif // EXCEPTION_ENABLED_APP_H
@@ -0,0 +1,169 @@
+// Fixation Predictor
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 15:42:18 CDT 2026
+
+#ifndef FIXATION_PREDICTOR_H
+#define FIXATION_PREDICTOR_H
+
+#include <QtGlobal>
+#include <cmath>
+
+namespace flying_dragon
+{
+
+/// @brief Predict where a viewer will be looking
+///
+/// Tracks fixation position and velocity with an alpha-beta
+/// filter over timestamped fixation samples, and extrapolates
+/// them to the time a frame will be displayed.  The filter's
+/// recent prediction error gives a confidence, which is used
+/// to widen the fovea when the prediction can't be trusted,
+/// for example during a saccade.
+///
+/// All times are MonotonicMicroseconds().
+class FixationPredictor
+{
+    public:
+    /// @brief Constructor
+    FixationPredictor ()
+    {
+        Reset ();
+    }
+    /// @brief Forget all samples
+    void Reset ()
+    {
+        samples_ = 0;
+        time_ = 0;
+        last_x_ = 0;
+        last_y_ = 0;
+        x_ = 0.0;
+        y_ = 0.0;
+        vx_ = 0.0;
+        vy_ = 0.0;
+        error_ = 0.0;
+        interval_ = 0.0;
+    }
+    /// @brief Add a fixation sample
+    /// @param x X coord in image pixels
+    /// @param y Y coord in image pixels
+    /// @param time The time the sample was taken
+    void Add (int x, int y, quint64 time)
+    {
+        const double dt = samples_ != 0 && time > time_ ? time - time_ : 0.0;
+        last_x_ = x;
+        last_y_ = y;
+        // A long gap means the viewer held still, so start over
+        if (samples_ == 0 || dt == 0.0 || dt > STILL_USECS)
+        {
+            if (samples_ == 0 || dt > STILL_USECS)
+            {
+                vx_ = 0.0;
+                vy_ = 0.0;
+                error_ = 0.0;
+            }
+            x_ = x;
+            y_ = y;
+            time_ = time;
+            ++samples_;
+            return;
+        }
+        // Predict, then correct by a fraction of the residual
+        const double px = x_ + vx_ * dt;
+        const double py = y_ + vy_ * dt;
+        const double rx = x - px;
+        const double ry = y - py;
+        x_ = px + rx * ALPHA_PERCENT / 100.0;
+        y_ = py + ry * ALPHA_PERCENT / 100.0;
+        vx_ += rx * BETA_PERCENT / 100.0 / dt;
+        vy_ += ry * BETA_PERCENT / 100.0 / dt;
+        // Smoothed prediction error over one sample interval
+        const double r = std::sqrt (rx * rx + ry * ry);
+        error_ = (7.0 * error_ + r) / 8.0;
+        interval_ = interval_ > 0.0 ? (7.0 * interval_ + dt) / 8.0 : dt;
+        time_ = time;
+        ++samples_;
+    }
+    /// @brief Predict the fixation at some time
+    /// @param time The time
+    /// @param x Set to the predicted x coord
+    /// @param y Set to the predicted y coord
+    /// @return false if there are no samples
+    bool Predict (quint64 time, int &x, int &y) const
+    {
+        if (samples_ == 0)
+            return false;
+        // Eyes don't keep moving for long.  Without newer
+        // samples, assume the viewer stopped where the last
+        // sample was.
+        if (IsStill (time))
+        {
+            x = last_x_;
+            y = last_y_;
+            return true;
+        }
+        const double dt = GetHorizon (time);
+        x = static_cast<int> (std::floor (x_ + vx_ * dt + 0.5));
+        y = static_cast<int> (std::floor (y_ + vy_ * dt + 0.5));
+        return true;
+    }
+    /// @brief Widen a fovea to cover the prediction's error
+    /// @param e2 The requested e2
+    /// @param time The time the prediction is for
+    ///
+    /// The expected error grows with how far past the last
+    /// sample the prediction reaches.
+    int WidenE2 (int e2, quint64 time) const
+    {
+        if (samples_ == 0 || interval_ <= 0.0 || IsStill (time))
+            return e2;
+        const double steps = qMax (1.0, GetHorizon (time) / interval_);
+        const int widened = e2 + static_cast<int> (error_ * steps);
+        return qMin (widened, e2 * MAX_E2_SCALE);
+    }
+    /// @brief Get the smoothed prediction error in pixels
+    double GetError () const
+    {
+        return error_;
+    }
+
+    private:
+    /// @brief Determine if the last sample is too old to
+    /// extrapolate from
+    bool IsStill (quint64 time) const
+    {
+        return time > time_ && time - time_ > STILL_USECS;
+    }
+    /// @brief How far past the last sample to extrapolate
+    double GetHorizon (quint64 time) const
+    {
+        if (time <= time_)
+            return 0.0;
+        const quint64 dt = time - time_;
+        const quint64 max_horizon = MAX_HORIZON_USECS;
+        return qMin (dt, max_horizon);
+    }
+
+    static const int ALPHA_PERCENT = 60;
+    static const int BETA_PERCENT = 20;
+    static const quint64 STILL_USECS = 250000;
+    static const quint64 MAX_HORIZON_USECS = 150000;
+    static const int MAX_E2_SCALE = 4;
+    quint64 samples_;
+    quint64 time_;
+    int last_x_;
+    int last_y_;
+    double x_;
+    double y_;
+    double vx_;
+    double vy_;
+    double error_;
+    double interval_;
+};
+
+} // namespace flying_dragon
+
+#endif // FIXATION_PREDICTOR_H
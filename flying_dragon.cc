@@ -12,33 +12,130 @@
 
 #include "argv.h"
 #include "exception_enabled_app.h"
+#include "headless_server.h"
 #include "main_window.h"
 #include "ui_flying_dragon.h"
 #include <iostream>
+#include <memory>
 
 using namespace std;
 using namespace jsp;
 using namespace flying_dragon;
 
+/// @brief Determine if an option appears in the args
+/// @param name The option's long name
+/// @param letter The option's short name
+///
+/// This looks at the args themselves, so it also finds
+/// options given their default values.
+bool IsGiven (int argc, char *argv[], const string &name, char letter)
+{
+    const string long_name = "--" + name;
+    const string short_name = string ("-") + letter;
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg (argv[i]);
+        if (arg == long_name || arg == short_name
+            || arg.compare (0, long_name.size () + 1, long_name + "=") == 0)
+            return true;
+    }
+    return false;
+}
+
+/// @brief Determine if the args ask for headless mode
+///
+/// The application has to be constructed before the args are
+/// parsed, and which one to construct depends on this.
+bool IsHeadless (int argc, char *argv[])
+{
+    return IsGiven (argc, argv, "headless", 'n');
+}
+
+/// @brief Find an option that only a headless server uses
+/// @return The option's long name, or an empty string
+string FindHeadlessOption (int argc, char *argv[])
+{
+    static const char *const names[] = { "device", "width", "height", "port", "fps", "encoding", "autotrack" };
+    static const char letters[] = { 'd', 'x', 'y', 'p', 'f', 'e', 'a' };
+    for (size_t i = 0; i < sizeof (letters); ++i)
+        if (IsGiven (argc, argv, names[i], letters[i]))
+            return names[i];
+    return string ();
+}
+
+/// @brief Parse an encoding name
+/// @param name "rgb32", "yuv420", or "foveated"
+/// @param encoding Set to the full resolution encoding
+/// @param foveated Set if the frames are foveated
+void ParseEncoding (const string &name, Frame::Encoding &encoding, bool &foveated)
+{
+    encoding = Frame::EncodingRGB32;
+    foveated = false;
+    if (name == "yuv420")
+        encoding = Frame::EncodingYUV420;
+    else if (name == "foveated")
+        foveated = true;
+    else if (name != "rgb32")
+        throw runtime_error ("unknown encoding: " + name);
+}
+
 int main(int argc, char *argv[])
 {
     try
     {
         // First let Qt parse args
-        ExceptionEnabledApplication app (argc, argv);
+        const bool headless = IsHeadless (argc, argv);
+        auto_ptr<QCoreApplication> app (headless
+            ? static_cast<QCoreApplication *> (new ExceptionEnabledCoreApplication (argc, argv))
+            : new ExceptionEnabledApplication (argc, argv));
+
+        // Note options meant for the other mode, whatever
+        // their values
+        const string headless_option = FindHeadlessOption (argc, argv);
+        const bool fixation_rate_given = IsGiven (argc, argv, "fixation-rate", 'r');
 
         // Parse remaining args
         bool help = false;
         bool verbose = false;
+        string latency_log;
+        int fixation_rate = 0;
+        bool headless_spec = false;
+        string device = "/dev/video0";
+        int width = 0;
+        int height = 0;
+        int port = 7480;
+        int fps = 0;
+        string encoding_name = "rgb32";
+        bool autotrack = false;
         CommandLine cl;
         cl.AddSpec ("help", 'h', help, "Print help message");
         cl.AddSpec ("verbose", 'v', verbose, "Verbose output");
+        cl.AddSpec ("latency-log", 'l', latency_log, "Log frame latencies to this file");
+        cl.AddSpec ("fixation-rate", 'r', fixation_rate, "Most fixations sent per second, 0 for the default");
+        cl.AddSpec ("headless", 'n', headless_spec, "Stream without a display");
+        cl.AddSpec ("device", 'd', device, "Headless capture source, for example /dev/video0 or synthetic");
+        cl.AddSpec ("width", 'x', width, "Headless frame width, 0 for the source's default");
+        cl.AddSpec ("height", 'y', height, "Headless frame height, 0 for the source's default");
+        cl.AddSpec ("port", 'p', port, "Headless server port");
+        cl.AddSpec ("fps", 'f', fps, "Headless frame rate, 0 for the source's rate");
+        cl.AddSpec ("encoding", 'e', encoding_name, "Headless encoding: rgb32, yuv420, or foveated");
+        cl.AddSpec ("autotrack", 'a', autotrack, "Headless foveation about the motion for clients that send no fixations");
         // Group argv's into option groups
         cl.GroupArgs (argc, argv, 1);
         // Convert from strings to their proper type
         cl.ExtractBegin ();
         cl.Extract (help);
         cl.Extract (verbose);
+        cl.Extract (latency_log);
+        cl.Extract (fixation_rate);
+        cl.Extract (headless_spec);
+        cl.Extract (device);
+        cl.Extract (width);
+        cl.Extract (height);
+        cl.Extract (port);
+        cl.Extract (fps);
+        cl.Extract (encoding_name);
+        cl.Extract (autotrack);
         cl.ExtractEnd ();
 
         if (help)
@@ -49,10 +146,44 @@ int main(int argc, char *argv[])
         }
         if (!cl.GetLeftOverArgs ().empty ())
             throw runtime_error ("usage: " + string (argv[0]) + " " + cl.Usage ());
+        if (width < 0 || height < 0 || fps < 0 || fixation_rate < 0)
+            throw runtime_error ("frame sizes and rates can't be negative");
+        if ((width == 0) != (height == 0))
+            throw runtime_error ("--width and --height must be given together");
+        if (!headless && !headless_option.empty ())
+            throw runtime_error ("--" + headless_option + " needs --headless\n"
+                "usage: " + string (argv[0]) + " " + cl.Usage ());
+
+        if (headless)
+        {
+            if (fixation_rate_given)
+                throw runtime_error ("--fixation-rate only applies with a display\n"
+                    "usage: " + string (argv[0]) + " " + cl.Usage ());
+            Frame::Encoding encoding;
+            bool foveated;
+            ParseEncoding (encoding_name, encoding, foveated);
+            flying_dragon::HeadlessServer server;
+            server.SetDefaultEncoding (encoding, foveated);
+            server.SetAutotrack (autotrack);
+            if (!latency_log.empty () &&
+                !server.SetLatencyLog (QString::fromStdString (latency_log)))
+                throw runtime_error ("could not open " + latency_log);
+            server.Start (QString::fromStdString (device), width, height, fps, port);
+            if (verbose)
+                clog << "streaming " << device
+                    << " " << server.GetWidth () << "x" << server.GetHeight ()
+                    << " on port " << port << endl;
+            return app->exec ();
+        }
 
         flying_dragon::MainWindow main_window (0);
+        if (!latency_log.empty () &&
+            !main_window.SetLatencyLog (QString::fromStdString (latency_log)))
+            throw runtime_error ("could not open " + latency_log);
+        if (fixation_rate != 0)
+            main_window.SetFixationRate (fixation_rate);
         main_window.show ();
-        return app.exec ();
+        return app->exec ();
     }
     catch (const std::exception &e)
     {
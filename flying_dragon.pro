@@ -13,6 +13,7 @@ INCLUDEPATH+=../horny-toad
 INCLUDEPATH+=../jack-rabbit
 INCLUDEPATH+=../screech-owl
 HEADERS += camera_controller.h
+HEADERS += capture_thread.h
 HEADERS += camera_controller_widget.h
 HEADERS += camera_dialog.h
 HEADERS += camera_setting_widgets.h
@@ -23,9 +24,11 @@ HEADERS += connection.h
 HEADERS += connection_manager.h
 HEADERS += connection_manager_widget.h
 HEADERS += exception_enabled_app.h
+HEADERS += headless_server.h
 HEADERS += main_window.h
 HEADERS += message.h
 HEADERS += message_manager.h
+HEADERS += motion_tracker.h
 HEADERS += persistent_dialog.h
 HEADERS += server.h
 HEADERS += server_widget.h
@@ -9,37 +9,517 @@
 #ifndef FRAME_H
 #define FRAME_H
 
+#include "video_frame.h"
+#include "yuyv.h"
+#include <QByteArray>
 #include <QImage>
 #include <cassert>
+#include <cstring>
+#include <vector>
 
 namespace flying_dragon
 {
 
-/// @brief An image frame
-class Frame : public QImage
+/// @brief An encoded image frame
+///
+/// A frame holds the serialized form of an image.  The
+/// serialized bytes are exactly what gets sent to a peer,
+/// so a frame can be handed to a message without copying
+/// the pixels again.
+///
+/// A foveated frame is a multi-resolution pyramid.  Level
+/// n of the pyramid is reduced by 2^n in each direction,
+/// the same convention used by jsp::pyramid.  The coarsest
+/// level covers the whole image.  Each finer level only
+/// covers a window around the fixation point, and the
+/// windows shrink as the levels get finer: level n is
+/// needed out to an eccentricity of e2 * (2^(n + 1) - 1)
+/// pixels, where resolution falls to 2^-(n + 1).  Each
+/// window is therefore about 4 * e2 samples wide, no
+/// matter how large the image is.
+///
+/// Serialized layout, all integers are 32 bit big endian:
+///
+///     encoding, width, height, fx, fy, e2,
+///     sequence, capture time (2 words, high first),
+///     encode time (2 words, high first)
+///     RGB32:    width * height * 4 bytes of pixels
+///     YUV420:   width * height bytes of Y, followed by
+///               (width / 2) * (height / 2) bytes each of
+///               U and V
+///     Foveated: levels
+///               for each level, coarsest first:
+///                   level, x, y, w, h
+///                   w * h * 3 bytes of RGB samples
+///
+/// The window of each level is given in that level's
+/// coordinates.
+class Frame
 {
     public:
+    /// @brief Frame encodings
+    enum Encoding
+    {
+        EncodingRGB32,
+        EncodingFoveated,
+        EncodingYUV420,
+        EncodingUnknown,
+    };
+    /// @brief Default e2 in pixels
+    static const int DEFAULT_E2 = 10;
+    /// @brief Constructor
     Frame ()
     {
     }
-    Frame (int width, int height, QImage::Format format)
-        : QImage (width, height, format)
+    /// @brief Encode a foveated image
+    /// @param image The image
+    /// @param fx Fixation x coord in image pixels
+    /// @param fy Fixation y coord in image pixels
+    /// @param e2 Eccentricity, in pixels, at which
+    /// resolution falls to one half
+    void Encode (const QImage &image, int fx, int fy, int e2)
     {
+        const QImage rgb = ToRGB32 (image);
+        const int w = rgb.width ();
+        const int h = rgb.height ();
+        fx = qBound (0, fx, w - 1);
+        fy = qBound (0, fy, h - 1);
+        e2 = qMax (1, e2);
+        const int levels = TotalLevels (w, h);
+        // Get the windows and the payload size
+        std::vector<Window> windows (levels);
+        int size = HEADER_SIZE + sizeof (qint32);
+        for (int n = 0; n < levels; ++n)
+        {
+            windows[n] = GetWindow (w, h, fx, fy, e2, n, levels);
+            size += WINDOW_HEADER_SIZE + windows[n].w * windows[n].h * 3;
+        }
+        // Build the pyramid
+        std::vector<QImage> pyramid (levels);
+        pyramid[0] = rgb;
+        for (int n = 1; n < levels; ++n)
+            pyramid[n] = Reduce (pyramid[n - 1]);
+        // Serialize the windows, coarsest first
+        data_ = QByteArray ();
+        data_.resize (size);
+        unsigned char *p = WriteHeader (EncodingFoveated, w, h, fx, fy, e2);
+        p = Put (p, levels);
+        for (int n = levels - 1; n >= 0; --n)
+        {
+            const Window &win = windows[n];
+            p = Put (p, n);
+            p = Put (p, win.x);
+            p = Put (p, win.y);
+            p = Put (p, win.w);
+            p = Put (p, win.h);
+            for (int y = win.y; y < win.y + win.h; ++y)
+            {
+                const QRgb *s = reinterpret_cast<const QRgb *> (pyramid[n].scanLine (y)) + win.x;
+                for (int x = 0; x < win.w; ++x)
+                {
+                    *p++ = static_cast<unsigned char> (qRed (s[x]));
+                    *p++ = static_cast<unsigned char> (qGreen (s[x]));
+                    *p++ = static_cast<unsigned char> (qBlue (s[x]));
+                }
+            }
+        }
+        assert (p == reinterpret_cast<unsigned char *> (data_.data ()) + data_.size ());
     }
-    void Encode (const QImage &image, int /*fx*/, int /*fy*/, int /*e2*/)
+    /// @brief Encode an image at full resolution
+    /// @param image The image
+    void Encode (const QImage &image)
     {
-        *static_cast<QImage *> (this) = image;
+        const QImage rgb = ToRGB32 (image);
+        const int w = rgb.width ();
+        const int h = rgb.height ();
+        data_ = QByteArray ();
+        data_.resize (HEADER_SIZE + w * h * 4);
+        unsigned char *p = WriteHeader (EncodingRGB32, w, h, 0, 0, 0);
+        for (int y = 0; y < h; ++y, p += w * 4)
+            memcpy (p, rgb.scanLine (y), w * 4);
     }
-    void Encode (const QImage &image)
+    /// @brief Encode the YV12 planes of a video frame
+    /// @param frame The video frame
+    ///
+    /// This takes 1.5 bytes per pixel instead of 4.  If the
+    /// video frame has no planes, or its size is odd, the
+    /// image is encoded as RGB32 instead.
+    void EncodeYUV420 (const VideoFrame &frame)
     {
-        *static_cast<QImage *> (this) = image;
+        const int w = frame.GetWidth ();
+        const int h = frame.GetHeight ();
+        if (!frame.HasYUV420 () || w % 2 != 0 || h % 2 != 0)
+        {
+            Encode (frame.GetImage ());
+            return;
+        }
+        const QByteArray &planes = frame.GetYUV420 ();
+        data_ = QByteArray ();
+        data_.resize (HEADER_SIZE + planes.size ());
+        unsigned char *p = WriteHeader (EncodingYUV420, w, h, 0, 0, 0);
+        memcpy (p, planes.constData (), planes.size ());
     }
+    /// @brief Decode the frame
+    /// @return The decoded image, or a null image if the
+    /// frame is not valid
     QImage Decode () const
     {
-        return *this;
+        if (!IsValid ())
+            return QImage ();
+        Header hdr = ReadHeader ();
+        const unsigned char *p = reinterpret_cast<const unsigned char *> (data_.constData ()) + HEADER_SIZE;
+        if (hdr.encoding == EncodingRGB32)
+        {
+            QImage image (hdr.width, hdr.height, QImage::Format_RGB32);
+            for (int y = 0; y < hdr.height; ++y, p += hdr.width * 4)
+                memcpy (image.scanLine (y), p, hdr.width * 4);
+            return image;
+        }
+        if (hdr.encoding == EncodingYUV420)
+        {
+            QImage image (hdr.width, hdr.height, QImage::Format_RGB32);
+            const int size = hdr.width * hdr.height;
+            YV122RGB32 (p,
+                p + size,
+                p + size + size / 4,
+                hdr.width,
+                hdr.height,
+                image.bits ());
+            return image;
+        }
+        assert (hdr.encoding == EncodingFoveated);
+        qint32 levels;
+        p = Get (p, levels);
+        // Expand each level up to the next finer one and
+        // paste that level's window on top of it
+        QImage image;
+        for (int n = levels - 1; n >= 0; --n)
+        {
+            Window win;
+            qint32 level;
+            p = Get (p, level);
+            p = Get (p, win.x);
+            p = Get (p, win.y);
+            p = Get (p, win.w);
+            p = Get (p, win.h);
+            assert (level == n);
+            const int lw = LevelExtent (hdr.width, n);
+            const int lh = LevelExtent (hdr.height, n);
+            if (image.isNull ())
+                image = QImage (lw, lh, QImage::Format_RGB32);
+            else
+                image = image.scaled (lw, lh, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            for (int y = win.y; y < win.y + win.h; ++y)
+            {
+                QRgb *d = reinterpret_cast<QRgb *> (image.scanLine (y)) + win.x;
+                for (int x = 0; x < win.w; ++x, p += 3)
+                    d[x] = qRgb (p[0], p[1], p[2]);
+            }
+        }
+        return image;
+    }
+    /// @brief Invariant checker
+    /// @return true if the serialized frame is consistent
+    bool IsValid () const
+    {
+        if (data_.size () < HEADER_SIZE)
+            return false;
+        Header hdr = ReadHeader ();
+        if (hdr.width < 0 || hdr.height < 0)
+            return false;
+        if (hdr.width > MAX_DIMENSION || hdr.height > MAX_DIMENSION)
+            return false;
+        switch (hdr.encoding)
+        {
+            case EncodingRGB32:
+            return data_.size () == HEADER_SIZE + hdr.width * hdr.height * 4;
+            case EncodingFoveated:
+            return IsValidPyramid (hdr);
+            case EncodingYUV420:
+            if (hdr.width % 2 != 0 || hdr.height % 2 != 0)
+                return false;
+            return data_.size () == HEADER_SIZE +
+                VideoFrame::YUV420Size (hdr.width, hdr.height);
+            default:
+            return false;
+        }
+    }
+    /// @brief Get the frame encoding
+    Encoding GetEncoding () const
+    {
+        if (data_.size () < HEADER_SIZE)
+            return EncodingUnknown;
+        return ReadHeader ().encoding;
+    }
+    /// @brief Get the width of the decoded image
+    int GetWidth () const
+    {
+        return data_.size () < HEADER_SIZE ? 0 : ReadHeader ().width;
+    }
+    /// @brief Get the height of the decoded image
+    int GetHeight () const
+    {
+        return data_.size () < HEADER_SIZE ? 0 : ReadHeader ().height;
+    }
+    /// @brief Stamp the frame with where it came from
+    /// @param sequence The video frame's sequence number
+    /// @param capture_time When the video frame was captured
+    /// @param encode_time When the frame was encoded
+    ///
+    /// Times are MonotonicMicroseconds() on the capturing
+    /// host.  Encoding clears the stamps.
+    void SetStamps (quint32 sequence, quint64 capture_time, quint64 encode_time)
+    {
+        assert (data_.size () >= HEADER_SIZE);
+        unsigned char *p = reinterpret_cast<unsigned char *> (data_.data ()) + STAMPS_OFFSET;
+        p = Put (p, static_cast<qint32> (sequence));
+        p = Put64 (p, capture_time);
+        p = Put64 (p, encode_time);
     }
-    protected:
+    /// @brief Get the sequence number of the video frame
+    quint32 GetSequence () const
+    {
+        return data_.size () < HEADER_SIZE ? 0 : ReadHeader ().sequence;
+    }
+    /// @brief Get when the video frame was captured
+    quint64 GetCaptureTime () const
+    {
+        return data_.size () < HEADER_SIZE ? 0 : ReadHeader ().capture_time;
+    }
+    /// @brief Get when the frame was encoded
+    quint64 GetEncodeTime () const
+    {
+        return data_.size () < HEADER_SIZE ? 0 : ReadHeader ().encode_time;
+    }
+    /// @brief Get the serialized frame
+    const QByteArray &GetData () const
+    {
+        return data_;
+    }
+    /// @brief Set the serialized frame
+    /// @param data Bytes previously returned by GetData()
+    ///
+    /// Call IsValid() to check the bytes before decoding
+    /// them.
+    void SetData (const QByteArray &data)
+    {
+        data_ = data;
+    }
+
     private:
+    /// @brief Serialized frame header
+    struct Header
+    {
+        Encoding encoding;
+        qint32 width;
+        qint32 height;
+        qint32 fx;
+        qint32 fy;
+        qint32 e2;
+        quint32 sequence;
+        quint64 capture_time;
+        quint64 encode_time;
+    };
+    /// @brief A pyramid level window in level coordinates
+    struct Window
+    {
+        qint32 x;
+        qint32 y;
+        qint32 w;
+        qint32 h;
+    };
+    static const int STAMPS_OFFSET = 6 * sizeof (qint32);
+    static const int HEADER_SIZE = 11 * sizeof (qint32);
+    static const int WINDOW_HEADER_SIZE = 5 * sizeof (qint32);
+    static const int MAX_LEVELS = 8;
+    static const int BASE_SIZE = 32;
+    static const int MAX_DIMENSION = 8192;
+    static QImage ToRGB32 (const QImage &image)
+    {
+        if (image.format () == QImage::Format_RGB32)
+            return image;
+        return image.convertToFormat (QImage::Format_RGB32);
+    }
+    /// @brief Get the width or height of a pyramid level
+    static int LevelExtent (int size, int level)
+    {
+        return (size + (1 << level) - 1) >> level;
+    }
+    /// @brief Get the number of pyramid levels for an image
+    ///
+    /// Levels are added until the coarsest one is no
+    /// larger than BASE_SIZE.
+    static int TotalLevels (int w, int h)
+    {
+        const int size = qMax (w, h);
+        int levels = 1;
+        while (levels < MAX_LEVELS && LevelExtent (size, levels - 1) > BASE_SIZE)
+            ++levels;
+        return levels;
+    }
+    /// @brief Get the window that is sent for a level
+    static Window GetWindow (int w, int h, int fx, int fy, int e2, int level, int levels)
+    {
+        const int lw = LevelExtent (w, level);
+        const int lh = LevelExtent (h, level);
+        Window win;
+        if (level == levels - 1)
+        {
+            win.x = 0;
+            win.y = 0;
+            win.w = lw;
+            win.h = lh;
+            return win;
+        }
+        // Radius, in level samples, out to which the next
+        // coarser level is not good enough
+        const int r = (e2 * ((2 << level) - 1) + (1 << level) - 1) >> level;
+        const int cx = fx >> level;
+        const int cy = fy >> level;
+        win.x = qMax (0, cx - r);
+        win.y = qMax (0, cy - r);
+        win.w = qMin (lw, cx + r + 1) - win.x;
+        win.h = qMin (lh, cy + r + 1) - win.y;
+        return win;
+    }
+    /// @brief Reduce an image by two in each direction
+    static QImage Reduce (const QImage &src)
+    {
+        const int w = LevelExtent (src.width (), 1);
+        const int h = LevelExtent (src.height (), 1);
+        QImage dst (w, h, QImage::Format_RGB32);
+        for (int y = 0; y < h; ++y)
+        {
+            const QRgb *s0 = reinterpret_cast<const QRgb *> (src.scanLine (2 * y));
+            const QRgb *s1 = 2 * y + 1 < src.height ()
+                ? reinterpret_cast<const QRgb *> (src.scanLine (2 * y + 1))
+                : s0;
+            QRgb *d = reinterpret_cast<QRgb *> (dst.scanLine (y));
+            for (int x = 0; x < w; ++x)
+            {
+                const int x0 = 2 * x;
+                const int x1 = x0 + 1 < src.width () ? x0 + 1 : x0;
+                d[x] = qRgb (
+                    (qRed (s0[x0]) + qRed (s0[x1]) + qRed (s1[x0]) + qRed (s1[x1]) + 2) / 4,
+                    (qGreen (s0[x0]) + qGreen (s0[x1]) + qGreen (s1[x0]) + qGreen (s1[x1]) + 2) / 4,
+                    (qBlue (s0[x0]) + qBlue (s0[x1]) + qBlue (s1[x0]) + qBlue (s1[x1]) + 2) / 4);
+            }
+        }
+        return dst;
+    }
+    /// @brief Check the level windows of a foveated frame
+    bool IsValidPyramid (const Header &hdr) const
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *> (data_.constData ());
+        const unsigned char *end = p + data_.size ();
+        p += HEADER_SIZE;
+        if (end - p < static_cast<int> (sizeof (qint32)))
+            return false;
+        qint32 levels;
+        p = Get (p, levels);
+        if (levels < 1 || levels > MAX_LEVELS)
+            return false;
+        for (int n = levels - 1; n >= 0; --n)
+        {
+            if (end - p < WINDOW_HEADER_SIZE)
+                return false;
+            Window win;
+            qint32 level;
+            p = Get (p, level);
+            p = Get (p, win.x);
+            p = Get (p, win.y);
+            p = Get (p, win.w);
+            p = Get (p, win.h);
+            const int lw = LevelExtent (hdr.width, n);
+            const int lh = LevelExtent (hdr.height, n);
+            if (level != n)
+                return false;
+            if (win.x < 0 || win.y < 0 || win.w < 0 || win.h < 0)
+                return false;
+            if (win.w > lw - win.x || win.h > lh - win.y)
+                return false;
+            // The coarsest level must cover the whole image
+            if (n == levels - 1 && (win.w != lw || win.h != lh))
+                return false;
+            if (end - p < win.w * win.h * 3)
+                return false;
+            p += win.w * win.h * 3;
+        }
+        return p == end;
+    }
+    /// @brief Serialize an integer in network byte order
+    static unsigned char *Put (unsigned char *p, qint32 v)
+    {
+        const quint32 u = static_cast<quint32> (v);
+        *p++ = static_cast<unsigned char> (u >> 24);
+        *p++ = static_cast<unsigned char> (u >> 16);
+        *p++ = static_cast<unsigned char> (u >> 8);
+        *p++ = static_cast<unsigned char> (u);
+        return p;
+    }
+    /// @brief Deserialize an integer in network byte order
+    static const unsigned char *Get (const unsigned char *p, qint32 &v)
+    {
+        v = static_cast<qint32> ((static_cast<quint32> (p[0]) << 24) |
+            (static_cast<quint32> (p[1]) << 16) |
+            (static_cast<quint32> (p[2]) << 8) |
+            static_cast<quint32> (p[3]));
+        return p + 4;
+    }
+    /// @brief Serialize a 64 bit integer as two integers
+    static unsigned char *Put64 (unsigned char *p, quint64 v)
+    {
+        p = Put (p, static_cast<qint32> (v >> 32));
+        return Put (p, static_cast<qint32> (v));
+    }
+    /// @brief Deserialize a 64 bit integer
+    static const unsigned char *Get64 (const unsigned char *p, quint64 &v)
+    {
+        qint32 hi;
+        qint32 lo;
+        p = Get (p, hi);
+        p = Get (p, lo);
+        v = (static_cast<quint64> (static_cast<quint32> (hi)) << 32) | static_cast<quint32> (lo);
+        return p;
+    }
+    unsigned char *WriteHeader (Encoding encoding, int w, int h, int fx, int fy, int e2)
+    {
+        assert (data_.size () >= HEADER_SIZE);
+        unsigned char *p = reinterpret_cast<unsigned char *> (data_.data ());
+        p = Put (p, encoding);
+        p = Put (p, w);
+        p = Put (p, h);
+        p = Put (p, fx);
+        p = Put (p, fy);
+        p = Put (p, e2);
+        p = Put (p, 0);
+        p = Put64 (p, 0);
+        p = Put64 (p, 0);
+        return p;
+    }
+    Header ReadHeader () const
+    {
+        assert (data_.size () >= HEADER_SIZE);
+        const unsigned char *p = reinterpret_cast<const unsigned char *> (data_.constData ());
+        qint32 encoding;
+        Header hdr;
+        p = Get (p, encoding);
+        p = Get (p, hdr.width);
+        p = Get (p, hdr.height);
+        p = Get (p, hdr.fx);
+        p = Get (p, hdr.fy);
+        p = Get (p, hdr.e2);
+        qint32 sequence;
+        p = Get (p, sequence);
+        hdr.sequence = static_cast<quint32> (sequence);
+        p = Get64 (p, hdr.capture_time);
+        p = Get64 (p, hdr.encode_time);
+        hdr.encoding = encoding >= EncodingRGB32 && encoding < EncodingUnknown
+            ? static_cast<Encoding> (encoding)
+            : EncodingUnknown;
+        return hdr;
+    }
+    QByteArray data_;
 };
 
 } // namespace flying_dragon
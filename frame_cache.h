@@ -0,0 +1,120 @@
+// Frame Cache
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 12:58:44 CDT 2026
+
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include "clock.h"
+#include "frame.h"
+#include "video_frame.h"
+#include <QHash>
+
+namespace flying_dragon
+{
+
+/// @brief Frame encoding parameters
+struct FrameKey
+{
+    /// @brief Constructor
+    FrameKey (int encoding, int fx, int fy, int e2)
+        : encoding (encoding)
+        , fx (fx)
+        , fy (fy)
+        , e2 (e2)
+    {
+    }
+    /// @brief Equality operator
+    bool operator== (const FrameKey &k) const
+    {
+        return encoding == k.encoding
+            && fx == k.fx
+            && fy == k.fy
+            && e2 == k.e2;
+    }
+    int encoding;
+    int fx;
+    int fy;
+    int e2;
+};
+
+/// @brief Hash a set of frame encoding parameters
+inline uint qHash (const FrameKey &k)
+{
+    return ((k.encoding * 31u + k.fx) * 31u + k.fy) * 31u + k.e2;
+}
+
+/// @brief The encodings of one video frame
+///
+/// Encodes a video frame at most once for each distinct set
+/// of encoding parameters.  Frames are implicitly shared, so
+/// every connection that asks for the same parameters sends
+/// the same payload and only the message headers differ.
+class FrameCache
+{
+    public:
+    /// @brief Constructor
+    /// @param frame The video frame to encode
+    ///
+    /// Video frames are implicitly shared, so the cache keeps
+    /// its own copy.
+    FrameCache (const VideoFrame &frame)
+        : frame_ (frame)
+    {
+    }
+    /// @brief Get the frame encoded at full resolution
+    /// @param encoding EncodingRGB32 or EncodingYUV420
+    Frame Get (Frame::Encoding encoding)
+    {
+        FrameKey key (encoding, 0, 0, 0);
+        if (!frames_.contains (key))
+        {
+            Frame f;
+            if (encoding == Frame::EncodingYUV420)
+                f.EncodeYUV420 (frame_);
+            else
+                f.Encode (frame_.GetImage ());
+            Stamp (f);
+            frames_.insert (key, f);
+        }
+        return frames_.value (key);
+    }
+    /// @brief Get the frame foveated about a fixation point
+    /// @param fx Fixation x coord
+    /// @param fy Fixation y coord
+    /// @param e2 Foveation e2 parameter
+    Frame Get (int fx, int fy, int e2)
+    {
+        FrameKey key (Frame::EncodingFoveated, fx, fy, e2);
+        if (!frames_.contains (key))
+        {
+            Frame f;
+            f.Encode (frame_.GetImage (), fx, fy, e2);
+            Stamp (f);
+            frames_.insert (key, f);
+        }
+        return frames_.value (key);
+    }
+    /// @brief Get the number of encodings that were made
+    int Total () const
+    {
+        return frames_.size ();
+    }
+
+    private:
+    /// @brief Stamp an encoding with where it came from
+    void Stamp (Frame &f) const
+    {
+        f.SetStamps (frame_.GetSequence (), frame_.GetCaptureTime (), MonotonicMicroseconds ());
+    }
+    const VideoFrame frame_;
+    QHash<FrameKey, Frame> frames_;
+};
+
+} // namespace flying_dragon
+
+#endif // FRAME_CACHE_H
@@ -0,0 +1,180 @@
+// Frame Latency
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 16:48:25 CDT 2026
+
+#ifndef FRAME_LATENCY_H
+#define FRAME_LATENCY_H
+
+#include "latency_stats.h"
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+#include <QtGlobal>
+#include <cassert>
+
+namespace flying_dragon
+{
+
+/// @brief Where the time goes between capturing a frame and
+/// painting it
+///
+/// Each displayed frame is followed through its stages, and
+/// the time spent in each stage is added to that stage's
+/// statistics.  A frame that is replaced by a newer one
+/// before it is painted is not counted.
+///
+/// All times are MonotonicMicroseconds() on the displaying
+/// host.  Times from the capturing host must be converted
+/// with a ClockSync first.
+class FrameLatency
+{
+    public:
+    /// @brief Frame stages
+    ///
+    /// Each stage ends with the event it is named after and
+    /// starts with the previous one.
+    enum Stage
+    {
+        StageEncode,
+        StageSend,
+        StageNetwork,
+        StageDecode,
+        StagePaint,
+        StageTotal,
+        STAGES,
+    };
+    /// @brief Constructor
+    FrameLatency ()
+        : log_ (0)
+        , log_id_ (0)
+    {
+        Clear ();
+    }
+    /// @brief Get the name of a stage
+    static QString GetName (Stage stage)
+    {
+        switch (stage)
+        {
+            case StageEncode:
+            return "encode";
+            case StageSend:
+            return "send";
+            case StageNetwork:
+            return "network";
+            case StageDecode:
+            return "decode";
+            case StagePaint:
+            return "paint";
+            case StageTotal:
+            return "total";
+            default:
+            return "unknown";
+        }
+    }
+    /// @brief Forget all frames
+    void Clear ()
+    {
+        for (int i = 0; i < STAGES; ++i)
+            stats_[i].Clear ();
+        has_frame_ = false;
+        decoded_ = false;
+    }
+    /// @brief Log each painted frame
+    /// @param log Where to write, or 0 to stop logging
+    /// @param id Identifies this stream in the log
+    ///
+    /// Each line holds the id, the frame's sequence number,
+    /// its capture time, and the microseconds spent in each
+    /// stage.  The device must outlive this object.
+    void SetLog (QIODevice *log, unsigned id)
+    {
+        log_ = log;
+        log_id_ = id;
+    }
+    /// @brief Get the header line of a log
+    static QByteArray GetLogHeader ()
+    {
+        QByteArray line ("id sequence capture");
+        for (int i = 0; i < STAGES; ++i)
+            line += " " + GetName (static_cast<Stage> (i)).toAscii ();
+        return line + "\n";
+    }
+    /// @brief A frame has arrived
+    /// @param sequence The frame's sequence number
+    /// @param captured When it was captured
+    /// @param encoded When it was encoded
+    /// @param sent When its first byte was sent
+    /// @param received When its last byte arrived
+    void Received (quint32 sequence, quint64 captured, quint64 encoded, quint64 sent, quint64 received)
+    {
+        sequence_ = sequence;
+        times_[StageEncode] = captured;
+        times_[StageSend] = encoded;
+        times_[StageNetwork] = sent;
+        times_[StageDecode] = received;
+        has_frame_ = true;
+        decoded_ = false;
+    }
+    /// @brief The newest frame has been decoded
+    /// @param time When
+    void Decoded (quint64 time)
+    {
+        if (!has_frame_)
+            return;
+        times_[StagePaint] = time;
+        decoded_ = true;
+    }
+    /// @brief The newest frame has been painted
+    /// @param time When
+    void Painted (quint64 time)
+    {
+        if (!has_frame_ || !decoded_)
+            return;
+        has_frame_ = false;
+        quint64 stage[STAGES];
+        // Each stage ends where the next one starts
+        for (int i = 0; i < StageTotal; ++i)
+        {
+            const quint64 end = i + 1 < StageTotal ? times_[i + 1] : time;
+            stage[i] = end > times_[i] ? end - times_[i] : 0;
+        }
+        stage[StageTotal] = time > times_[StageEncode] ? time - times_[StageEncode] : 0;
+        for (int i = 0; i < STAGES; ++i)
+            stats_[i].Add (stage[i]);
+        if (log_)
+        {
+            QByteArray line = QByteArray::number (log_id_)
+                + " " + QByteArray::number (sequence_)
+                + " " + QByteArray::number (times_[StageEncode]);
+            for (int i = 0; i < STAGES; ++i)
+                line += " " + QByteArray::number (stage[i]);
+            log_->write (line + "\n");
+        }
+    }
+    /// @brief Get the statistics for a stage
+    /// @return Min, mean, median, and 99th percentile of
+    /// the stage times of recent frames, in microseconds
+    const LatencyStats &GetStats (Stage stage) const
+    {
+        assert (stage >= 0 && stage < STAGES);
+        return stats_[stage];
+    }
+
+    private:
+    LatencyStats stats_[STAGES];
+    QIODevice *log_;
+    unsigned log_id_;
+    bool has_frame_;
+    bool decoded_;
+    quint32 sequence_;
+    // The time each stage starts
+    quint64 times_[StageTotal];
+};
+
+} // namespace flying_dragon
+
+#endif // FRAME_LATENCY_H
@@ -0,0 +1,131 @@
+// Headless Server
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 18:05:12 CDT 2026
+
+#ifndef HEADLESS_SERVER_H
+#define HEADLESS_SERVER_H
+
+#include "camera_controller.h"
+#include "connection.h"
+#include "connection_manager.h"
+#include "motion_tracker.h"
+#include "server.h"
+#include "video_frame.h"
+#include <QDebug>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+namespace flying_dragon
+{
+
+/// @brief Stream a capture source without a GUI
+///
+/// Opens a capture source, listens for clients, and sends
+/// frames to each client that asks for them.  Nothing here
+/// needs a display, so it runs under a QCoreApplication.
+/// Clients that go away are forgotten.
+class HeadlessServer : public QObject
+{
+    Q_OBJECT
+
+    public:
+    /// @brief Constructor
+    HeadlessServer ()
+        : server_ (connection_manager_)
+    {
+        QObject::connect (&camera_controller_, SIGNAL(NewIcon (const QImage &)),
+            &connection_manager_, SLOT(NewIcon (const QImage &)));
+        // Track each frame before it is sent
+        QObject::connect (&camera_controller_, SIGNAL(NewVideoFrame (const VideoFrame &)),
+            &motion_tracker_, SLOT(NewFrame (const VideoFrame &)));
+        QObject::connect (&camera_controller_, SIGNAL(NewVideoFrame (const VideoFrame &)),
+            &connection_manager_, SLOT(NewFrame (const VideoFrame &)));
+        QObject::connect (&motion_tracker_, SIGNAL(NewFixation (int, int)),
+            &connection_manager_, SLOT(AutoFixation (int, int)));
+        QObject::connect (&motion_tracker_, SIGNAL(Stopped ()),
+            &connection_manager_, SLOT(ClearAutoFixation ()));
+        // A connection can close without telling anyone, so
+        // look for closed ones every so often
+        QObject::connect (&sweep_timer_, SIGNAL(timeout()),
+            this, SLOT(RemoveDisconnected()));
+        sweep_timer_.start (SWEEP_MSECS);
+    }
+    /// @brief Set how frames are sent to new clients
+    /// @param encoding The full resolution encoding
+    /// @param foveated Whether frames are foveated
+    void SetDefaultEncoding (Frame::Encoding encoding, bool foveated)
+    {
+        connection_manager_.SetDefaultEncoding (encoding, foveated);
+    }
+    /// @brief Turn motion tracking on or off
+    ///
+    /// While it is on, clients that do not send fixations
+    /// get frames foveated about the motion, unless they have
+    /// turned foveation off.
+    void SetAutotrack (bool state)
+    {
+        motion_tracker_.SetEnabled (state);
+    }
+    /// @brief Log the stage times of every frame displayed
+    /// @param filename The log file
+    /// @return false if the file could not be opened
+    bool SetLatencyLog (const QString &filename)
+    {
+        return connection_manager_.SetLatencyLog (filename);
+    }
+    /// @brief Start capturing and listening
+    /// @param device_name The capture source, see
+    /// CreateCaptureSource()
+    /// @param width Frame width if the name has none, or 0
+    /// @param height Frame height if the name has none, or 0
+    /// @param fps Frame rate if the name has none, or 0
+    /// @param port Listen at this port number
+    void Start (const QString &device_name,
+        unsigned width, unsigned height, unsigned fps, int port)
+    {
+        camera_controller_.Open (device_name, width, height, fps);
+        camera_controller_.StartCapture ();
+        server_.Listen (port);
+    }
+    /// @brief Stop listening and capturing
+    void Stop ()
+    {
+        server_.Close ();
+        camera_controller_.StopCapture ();
+        camera_controller_.Close ();
+    }
+    /// @brief Get the frame width
+    size_t GetWidth () const
+    {
+        return camera_controller_.GetWidth ();
+    }
+    /// @brief Get the frame height
+    size_t GetHeight () const
+    {
+        return camera_controller_.GetHeight ();
+    }
+
+    private slots:
+    void RemoveDisconnected ()
+    {
+        connection_manager_.RemoveDisconnected ();
+    }
+
+    private:
+    // Declared in the order they must be built
+    CameraController camera_controller_;
+    MotionTracker motion_tracker_;
+    ConnectionManager connection_manager_;
+    Server server_;
+    static const int SWEEP_MSECS = 1000;
+    QTimer sweep_timer_;
+};
+
+} // namespace flying_dragon
+
+#endif // HEADLESS_SERVER_H
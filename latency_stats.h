@@ -0,0 +1,123 @@
+// Latency Statistics
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 14:26:03 CDT 2026
+
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <QVector>
+#include <QtGlobal>
+#include <algorithm>
+#include <cassert>
+
+namespace flying_dragon
+{
+
+/// @brief Summary statistics for a set of latencies
+///
+/// Keeps the most recent samples and reports their min,
+/// mean, median, and 99th percentile.  Samples are in
+/// microseconds.
+class LatencyStats
+{
+    public:
+    /// @brief Constructor
+    /// @param capacity Number of recent samples to keep
+    LatencyStats (int capacity = DEFAULT_CAPACITY)
+        : samples_ (capacity)
+        , next_ (0)
+        , size_ (0)
+        , total_ (0)
+    {
+        assert (capacity > 0);
+    }
+    /// @brief Forget all samples
+    void Clear ()
+    {
+        next_ = 0;
+        size_ = 0;
+        total_ = 0;
+    }
+    /// @brief Add a sample
+    /// @param usecs The latency in microseconds
+    void Add (quint64 usecs)
+    {
+        samples_[next_] = usecs;
+        next_ = (next_ + 1) % samples_.size ();
+        if (size_ < samples_.size ())
+            ++size_;
+        ++total_;
+    }
+    /// @brief Get the number of samples kept
+    int GetSize () const
+    {
+        return size_;
+    }
+    /// @brief Get the number of samples ever added
+    quint64 GetTotal () const
+    {
+        return total_;
+    }
+    /// @brief Get the most recent sample
+    quint64 GetLast () const
+    {
+        if (size_ == 0)
+            return 0;
+        return samples_[(next_ + samples_.size () - 1) % samples_.size ()];
+    }
+    /// @brief Get the smallest sample
+    quint64 GetMin () const
+    {
+        if (size_ == 0)
+            return 0;
+        return *std::min_element (samples_.begin (), samples_.begin () + size_);
+    }
+    /// @brief Get the mean of the samples
+    quint64 GetMean () const
+    {
+        if (size_ == 0)
+            return 0;
+        quint64 sum = 0;
+        for (int i = 0; i < size_; ++i)
+            sum += samples_[i];
+        return sum / size_;
+    }
+    /// @brief Get a percentile of the samples
+    /// @param p The percentile, from 0 to 100
+    quint64 GetPercentile (int p) const
+    {
+        assert (p >= 0 && p <= 100);
+        if (size_ == 0)
+            return 0;
+        QVector<quint64> sorted (size_);
+        std::copy (samples_.begin (), samples_.begin () + size_, sorted.begin ());
+        const int n = (size_ - 1) * p / 100;
+        std::nth_element (sorted.begin (), sorted.begin () + n, sorted.end ());
+        return sorted[n];
+    }
+    /// @brief Get the median of the samples
+    quint64 GetP50 () const
+    {
+        return GetPercentile (50);
+    }
+    /// @brief Get the 99th percentile of the samples
+    quint64 GetP99 () const
+    {
+        return GetPercentile (99);
+    }
+
+    private:
+    static const int DEFAULT_CAPACITY = 1024;
+    QVector<quint64> samples_;
+    int next_;
+    int size_;
+    quint64 total_;
+};
+
+} // namespace flying_dragon
+
+#endif // LATENCY_STATS_H
@@ -12,6 +12,7 @@
 #include "camera_controller_widget.h"
 #include "client_widget.h"
 #include "connection_manager_widget.h"
+#include "motion_tracker.h"
 #include "server_widget.h"
 #include "ui_flying_dragon.h"
 #include <QCloseEvent>
@@ -56,8 +57,32 @@ class MainWindow : public QMainWindow
 
         QObject::connect (&camera_controller_, SIGNAL(NewIcon (const QImage &)),
             &connection_manager_, SLOT(NewIcon (const QImage &)));
-        QObject::connect (&camera_controller_, SIGNAL(NewFrame (const QImage &)),
-            &connection_manager_, SLOT(NewFrame (const QImage &)));
+        // Track each frame before it is sent
+        QObject::connect (&camera_controller_, SIGNAL(NewVideoFrame (const VideoFrame &)),
+            &motion_tracker_, SLOT(NewFrame (const VideoFrame &)));
+        QObject::connect (&camera_controller_, SIGNAL(NewVideoFrame (const VideoFrame &)),
+            &connection_manager_, SLOT(NewFrame (const VideoFrame &)));
+        QObject::connect (&motion_tracker_, SIGNAL(NewFixation (int, int)),
+            &connection_manager_, SLOT(AutoFixation (int, int)));
+        QObject::connect (&motion_tracker_, SIGNAL(Stopped ()),
+            &connection_manager_, SLOT(ClearAutoFixation ()));
+        QObject::connect (server_widget_, SIGNAL(AutotrackChanged (bool)),
+            &motion_tracker_, SLOT(SetEnabled (bool)));
+    }
+
+    /// @brief Log the stage times of every frame displayed
+    /// @param filename The log file
+    /// @return false if the file could not be opened
+    bool SetLatencyLog (const QString &filename)
+    {
+        return connection_manager_.SetLatencyLog (filename);
+    }
+    /// @brief Set the most fixations sent to each server per
+    /// second
+    /// @param rate Fixations per second
+    void SetFixationRate (int rate)
+    {
+        connection_manager_.SetFixationRate (rate);
     }
 
     protected:
@@ -123,6 +148,7 @@ class MainWindow : public QMainWindow
     Ui::MainWindow ui_;
     QSettings settings_;
     CameraController camera_controller_;
+    MotionTracker motion_tracker_;
     ConnectionManager connection_manager_;
     Client client_;
     Server server_;
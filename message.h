@@ -9,18 +9,32 @@
 #ifndef MESSAGE_H
 #define MESSAGE_H
 
+#include "clock.h"
 #include "frame.h"
 #include <QByteArray>
 #include <QDataStream>
 #include <QDebug>
 #include <QImage>
-#include <QTime>
+#include <QtEndian>
 #include <cassert>
 
 namespace flying_dragon
 {
 
 /// @brief A network message
+///
+/// On the wire a message is a fixed size header followed by
+/// the message data.  The header fields are little-endian and
+/// packed:
+///
+///     offset  size  field
+///          0     4  magic
+///          4     2  version
+///          6     1  type
+///          7     1  flags
+///          8     8  id
+///         16     8  timestamp, monotonic microseconds
+///         24     4  data size
 class Message
 {
     public:
@@ -38,14 +52,36 @@ class Message
         TypeFrame,
         TypeFixation,
         TypeText,
+        TypeFormatCommand,
+        TypeFrameFragment,
         TypeUnknown,
     };
     ///}
+    /// @brief Size of a serialized message header
+    static const int HEADER_SIZE =
+        sizeof (quint32) + // magic
+        sizeof (quint16) + // version
+        sizeof (quint8) + // type
+        sizeof (quint8) + // flags
+        sizeof (quint64) + // id
+        sizeof (quint64) + // timestamp
+        sizeof (quint32); // data size
+    /// @brief Size of the fragment header at the start of a
+    /// frame fragment's data
+    static const int FRAGMENT_HEADER_SIZE =
+        sizeof (quint64) + // frame id
+        sizeof (quint32) + // frame size
+        sizeof (quint32); // offset
+    /// @brief Largest amount of data a message can carry
+    static const int MAX_DATA_SIZE = 1024 * 1024 * 16;
     /// @brief Constructor
     Message ()
         : type_ (TypeUnknown)
+        , flags_ (0)
         , id_ (0)
-        , time_ (QTime (0, 0))
+        , timestamp_ (0)
+        , payload_offset_ (0)
+        , payload_size_ (0)
     {
     }
     /// @brief Invariant checker
@@ -54,7 +90,7 @@ class Message
     {
         if (type_ == TypeUnknown)
             return false;
-        if (data_.size () > MAX_DATA_SIZE)
+        if (GetSize () > MAX_DATA_SIZE)
             return false;
         return true;
     }
@@ -101,6 +137,12 @@ class Message
             case TypeText:
                 name = "Text";
             break;
+            case TypeFormatCommand:
+                name = "FormatCommand";
+            break;
+            case TypeFrameFragment:
+                name = "FrameFragment";
+            break;
             default:
             case TypeUnknown:
                 name = "Unknown";
@@ -114,28 +156,104 @@ class Message
     {
         return id_;
     }
+    /// @brief Set the message ID number
+    /// @param id The ID
+    ///
+    /// Messages are numbered when they are written, so that
+    /// ids arrive in order even when urgent messages overtake
+    /// queued ones.
+    void SetID (quint64 id)
+    {
+        id_ = id;
+    }
+    /// @brief Get the message flags
+    /// @return The flags
+    quint8 GetFlags () const
+    {
+        return flags_;
+    }
     /// @brief Get the message timestamp
-    /// @return The timestamp
-    QTime GetTime () const
+    /// @return The time the message was sent, in
+    /// MonotonicMicroseconds() on the sending host
+    quint64 GetTimestamp () const
     {
-        return time_;
+        return timestamp_;
+    }
+    /// @brief Set the message timestamp
+    /// @param timestamp The time the message is sent
+    ///
+    /// Messages are stamped when they are created, and again
+    /// when they are written, so time spent in send queues is
+    /// not counted as time on the network.
+    void SetTimestamp (quint64 timestamp)
+    {
+        timestamp_ = timestamp;
     }
     /// @brief Get a serialized message header
     /// @return The header
     const QByteArray GetHeader () const
     {
-        QByteArray header;
-        QDataStream s (&header, QIODevice::WriteOnly);
-        s << static_cast<quint32> (type_);
-        s << static_cast<quint64> (id_);
-        s << time_;
-        s << static_cast<quint32> (data_.size ());
+        QByteArray header (HEADER_SIZE, 0);
+        WriteHeader (reinterpret_cast<uchar *> (header.data ()));
+        return header;
+    }
+    /// @brief Serialize the message header
+    /// @param p Buffer of at least HEADER_SIZE bytes
+    void WriteHeader (uchar *p) const
+    {
+        qToLittleEndian<quint32> (MAGIC, p + 0);
+        qToLittleEndian<quint16> (VERSION, p + 4);
+        p[6] = static_cast<uchar> (type_);
+        p[7] = flags_;
+        qToLittleEndian<quint64> (id_, p + 8);
+        qToLittleEndian<quint64> (timestamp_, p + 16);
+        qToLittleEndian<quint32> (GetSize (), p + 24);
         //qDebug() << this << "initing";
         //qDebug() << this << "type_=" << static_cast<int> (type_);
         //qDebug() << this << "id_=" << id_;
-        //qDebug() << this << "time_=" << time_.toString ();
+        //qDebug() << this << "timestamp_=" << timestamp_;
         //qDebug() << this << "data_.size()=" << data_.size ();
-        return header;
+    }
+    /// @brief Get the number of bytes that follow the header
+    int GetSize () const
+    {
+        return data_.size () + payload_size_;
+    }
+    /// @brief Get the bytes sent after the data
+    ///
+    /// A message can send part of a buffer it shares after its
+    /// own data, so that the buffer is never copied.  Messages
+    /// that have been read never have a payload: whatever
+    /// followed the header is in the data.
+    const char *GetPayload () const
+    {
+        return payload_.constData () + payload_offset_;
+    }
+    /// @brief Get the size of the payload
+    int GetPayloadSize () const
+    {
+        return payload_size_;
+    }
+    /// @brief Get the fragment header of a frame fragment
+    /// @param frame_id Set to the id of the frame
+    /// @param frame_size Set to the size of the whole frame
+    /// @param offset Set to where the fragment goes in the
+    /// frame
+    /// @return false if the fragment header is malformed
+    bool GetFragment (quint64 &frame_id, int &frame_size, int &offset) const
+    {
+        assert (type_ == TypeFrameFragment);
+        if (data_.size () < FRAGMENT_HEADER_SIZE)
+            return false;
+        const uchar *p = reinterpret_cast<const uchar *> (data_.constData ());
+        frame_id = qFromLittleEndian<quint64> (p + 0);
+        const quint32 size = qFromLittleEndian<quint32> (p + 8);
+        const quint32 off = qFromLittleEndian<quint32> (p + 12);
+        if (size > static_cast<quint32> (MAX_DATA_SIZE) || off > size)
+            return false;
+        frame_size = size;
+        offset = off;
+        return true;
     }
     /// @brief Fill an image with an icon
     void GetIcon (QImage &icon)
@@ -151,17 +269,12 @@ class Message
         memcpy (icon.bits (), data_.data () + 8, icon.numBytes ());
     }
     /// @brief Fill a frame with data
+    ///
+    /// The frame shares the message data, so no pixels are
+    /// copied.
     void GetFrame (Frame &frame)
     {
-        QDataStream s (data_);
-        qint32 width;
-        qint32 height;
-        s >> width;
-        s >> height;
-        //qDebug() << "frame" << width << height;
-        frame = Frame (width, height, QImage::Format_RGB32);
-        assert (frame.numBytes () == data_.size () - 8);
-        memcpy (frame.bits (), data_.data () + 8, frame.numBytes ());
+        frame.SetData (data_);
     }
     /// @brief Get x and y coords
     void GetFixation (int &fx, int &fy, int &e2)
@@ -177,6 +290,34 @@ class Message
         fy = y;
         e2 = e;
     }
+    /// @brief Get the contents of an ack
+    /// @param id Set to the id of the newest acknowledged
+    /// message
+    /// @param timestamp Set to that message's timestamp
+    /// @param delay Set to the microseconds the peer held the
+    /// ack before sending it
+    /// @return false if the ack data is malformed
+    bool GetAck (quint64 &id, quint64 &timestamp, quint32 &delay) const
+    {
+        assert (type_ == TypeAck);
+        if (data_.size () != ACK_DATA_SIZE)
+            return false;
+        const uchar *p = reinterpret_cast<const uchar *> (data_.constData ());
+        id = qFromLittleEndian<quint64> (p + 0);
+        timestamp = qFromLittleEndian<quint64> (p + 8);
+        delay = qFromLittleEndian<quint32> (p + 16);
+        return true;
+    }
+    /// @brief Get a frame encoding
+    Frame::Encoding GetEncoding ()
+    {
+        QDataStream s (data_);
+        qint32 encoding;
+        s >> encoding;
+        if (encoding < Frame::EncodingRGB32 || encoding >= Frame::EncodingUnknown)
+            return Frame::EncodingUnknown;
+        return static_cast<Frame::Encoding> (encoding);
+    }
     /// @brief Get a state
     bool GetState ()
     {
@@ -193,6 +334,61 @@ class Message
     {
         return data_;
     }
+    /// @brief Get the size of a serialized message header
+    static int GetHeaderSize ()
+    {
+        return HEADER_SIZE;
+    }
+    /// @brief Read a message header
+    /// @param header GetHeaderSize() bytes containing a header
+    /// @param data_size Set to the number of data bytes that
+    /// follow the header
+    /// @return false if the header is invalid or comes from
+    /// a different protocol version
+    ///
+    /// On success the message takes the type, flags, id, and
+    /// timestamp from the header and its data is cleared.  Use
+    /// SetData() once the data bytes have arrived.
+    bool ReadHeader (const QByteArray &header, int &data_size)
+    {
+        assert (header.size () == HEADER_SIZE);
+        const uchar *p = reinterpret_cast<const uchar *> (header.constData ());
+        quint32 magic = qFromLittleEndian<quint32> (p + 0);
+        quint16 version = qFromLittleEndian<quint16> (p + 4);
+        quint8 type = p[6];
+        quint8 flags = p[7];
+        quint64 id = qFromLittleEndian<quint64> (p + 8);
+        quint64 timestamp = qFromLittleEndian<quint64> (p + 16);
+        quint32 size = qFromLittleEndian<quint32> (p + 24);
+        //qDebug() << this << "reading";
+        //qDebug() << this << "type=" << static_cast<int> (type);
+        //qDebug() << this << "id=" << id;
+        //qDebug() << this << "timestamp=" << timestamp;
+        //qDebug() << this << "data_size=" << size;
+        if (magic != MAGIC || version != VERSION)
+            return false;
+        if (type >= TypeUnknown)
+            return false;
+        if (size > static_cast<quint32> (MAX_DATA_SIZE))
+            return false;
+        // Commit
+        type_ = static_cast<Type> (type);
+        flags_ = flags;
+        id_ = id;
+        timestamp_ = timestamp;
+        data_ = QByteArray ();
+        data_size = size;
+        return true;
+    }
+    /// @brief Set the message data
+    /// @param data The data that followed the header
+    ///
+    /// The message shares the data, so no bytes are copied.
+    void SetData (const QByteArray &data)
+    {
+        data_ = data;
+        assert (this->IsValid ());
+    }
     /// @brief Try to read a message
     /// @param bytes Bytes containing a message
     /// @return true on successful read
@@ -205,49 +401,29 @@ class Message
         // Can we get the header?
         if (bytes.size () < HEADER_SIZE)
             return false;
-        QByteArray header = QByteArray (
-            bytes.constData (),
-            HEADER_SIZE);
-        QDataStream s (header);
-        quint32 type;
-        quint64 id;
-        QTime time;
-        quint32 data_size;
-        s >> type;
-        s >> id;
-        s >> time;
-        s >> data_size;
-        //qDebug() << this << "reading";
-        //qDebug() << this << "type=" << static_cast<int> (type);
-        //qDebug() << this << "id=" << id;
-        //qDebug() << this << "time=" << time;
-        //qDebug() << this << "data_size=" << data_size;
+        Message msg;
+        int data_size;
+        if (!msg.ReadHeader (bytes.left (HEADER_SIZE), data_size))
+            return false;
         // Can we get the data?
-        if (bytes.size () < static_cast<int> (data_size + HEADER_SIZE))
+        if (bytes.size () < data_size + HEADER_SIZE)
             return false;
         // Commit
-        type_ = static_cast<Type> (type);
-        id_ = static_cast<Type> (id);
-        time_ = time;
-        data_ = QByteArray (
-            bytes.constData () + HEADER_SIZE,
-            data_size);
-        assert (this->IsValid ());
+        msg.SetData (bytes.mid (HEADER_SIZE, data_size));
+        *this = msg;
         return true;
     }
 
     private:
     Type type_;
+    quint8 flags_;
     quint64 id_;
-    QTime time_;
-    static const int HEADER_SIZE =
-        sizeof (quint32) + // type
-        sizeof (quint64) + // id
-        sizeof (QTime) + // time
-        sizeof (quint32); // data size
-    static const int MAX_DATA_SIZE = 1024 * 1024 * 16;
+    quint64 timestamp_;
+    static const quint32 MAGIC = 0x47445246; // "FRDG"
+    static const quint16 VERSION = 1;
 
     protected:
+    static const int ACK_DATA_SIZE = 2 * sizeof (quint64) + sizeof (quint32);
     /// @brief Constructor
     /// @param type Message type
     /// @param id Message ID
@@ -257,10 +433,25 @@ class Message
     /// message classes.
     Message (Type type, quint64 id, const QByteArray &data = QByteArray ())
         : type_ (type)
+        , flags_ (0)
         , id_ (id)
-        , time_ (QTime::currentTime ())
+        , timestamp_ (MonotonicMicroseconds ())
         , data_ (data)
+        , payload_offset_ (0)
+        , payload_size_ (0)
+    {
+    }
+    /// @brief Send part of a buffer after the data
+    /// @param payload The buffer, which the message shares
+    /// @param offset Where the part starts
+    /// @param size The size of the part
+    void SetPayload (const QByteArray &payload, int offset, int size)
     {
+        assert (offset >= 0 && size >= 0);
+        assert (offset + size <= payload.size ());
+        payload_ = payload;
+        payload_offset_ = offset;
+        payload_size_ = size;
     }
     /// @brief Serialized message data
     ///
@@ -268,18 +459,37 @@ class Message
     /// This will avoid copying messages that are
     /// potentially very large.
     QByteArray data_;
+
+    private:
+    QByteArray payload_;
+    int payload_offset_;
+    int payload_size_;
 };
 
-/// @brief An acknowledgement of a message
+/// @brief An acknowledgement of messages
+///
+/// Acks are cumulative.  Messages arrive in order, so an ack
+/// for one message acknowledges every message the peer sent
+/// before it.  The ack echoes the id and timestamp of the
+/// newest message, and says how long the ack was held, so
+/// the sender can time the round trip with its own clock.
 class AckMessage : public Message
 {
     public:
     /// @brief Constructor
     /// @param id Message ID
-    /// @param data Ack data
-    AckMessage (quint64 id, const QByteArray &data)
-        : Message (TypeAck, id, data)
-    { }
+    /// @param acked_id ID of the newest message received
+    /// @param acked_timestamp Timestamp of that message
+    /// @param delay Microseconds between receiving that
+    /// message and sending this ack
+    AckMessage (quint64 id, quint64 acked_id, quint64 acked_timestamp, quint32 delay)
+        : Message (TypeAck, id, QByteArray (ACK_DATA_SIZE, 0))
+    {
+        uchar *p = reinterpret_cast<uchar *> (data_.data ());
+        qToLittleEndian<quint64> (acked_id, p + 0);
+        qToLittleEndian<quint64> (acked_timestamp, p + 8);
+        qToLittleEndian<quint32> (delay, p + 16);
+    }
 
     private:
 };
@@ -345,6 +555,26 @@ class FoveateCommandMessage : public Message
     private:
 };
 
+/// @brief A message that requests a frame encoding
+///
+/// Each peer sends this once it is connected to tell the
+/// other peer how it would like unfoveated frames encoded.
+class FormatCommandMessage : public Message
+{
+    public:
+    /// @brief Constructor
+    /// @param id The message ID
+    /// @param encoding The requested encoding
+    FormatCommandMessage (quint64 id, Frame::Encoding encoding)
+        : Message (TypeFormatCommand, id)
+    {
+        QDataStream s (&data_, QIODevice::WriteOnly);
+        s << static_cast<qint32> (encoding);
+    }
+
+    private:
+};
+
 /// @brief A message containing an icon image
 class IconMessage : public Message
 {
@@ -370,14 +600,39 @@ class FrameMessage : public Message
     public:
     /// @brief Constructor
     /// @param id The message ID
-    /// @param frame Frame image
+    /// @param frame Encoded frame
     FrameMessage (quint64 id, const Frame &frame)
-        : Message (TypeFrame, id)
+        : Message (TypeFrame, id, frame.GetData ())
     {
-        QDataStream s (&data_, QIODevice::WriteOnly);
-        s << static_cast<qint32> (frame.width ());
-        s << static_cast<qint32> (frame.height ());
-        data_ += QByteArray (reinterpret_cast<const char *> (frame.bits ()), frame.numBytes ());
+    }
+
+    private:
+};
+
+/// @brief A message containing part of a frame
+///
+/// Large frames are sent as a series of fragments so that
+/// other messages can be sent between them.  The data is a
+/// fragment header (frame id, frame size, and offset, all
+/// little-endian) followed by the fragment's bytes, which are
+/// sent straight from the frame.
+class FrameFragmentMessage : public Message
+{
+    public:
+    /// @brief Constructor
+    /// @param id The message ID
+    /// @param frame_id The frame's ID
+    /// @param frame Encoded frame
+    /// @param offset Where the fragment starts in the frame
+    /// @param size The size of the fragment
+    FrameFragmentMessage (quint64 id, quint64 frame_id, const Frame &frame, int offset, int size)
+        : Message (TypeFrameFragment, id, QByteArray (FRAGMENT_HEADER_SIZE, 0))
+    {
+        uchar *p = reinterpret_cast<uchar *> (data_.data ());
+        qToLittleEndian<quint64> (frame_id, p + 0);
+        qToLittleEndian<quint32> (frame.GetData ().size (), p + 8);
+        qToLittleEndian<quint32> (offset, p + 12);
+        SetPayload (frame.GetData (), offset, size);
     }
 
     private:
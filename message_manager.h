@@ -9,12 +9,24 @@
 #ifndef MESSAGE_MANAGER_H
 #define MESSAGE_MANAGER_H
 
+#include "clock.h"
+#include "clock_sync.h"
 #include "frame.h"
+#include "frame_latency.h"
+#include "latency_stats.h"
 #include "message.h"
+#include <QMap>
 #include <QObject>
+#include <QQueue>
 #include <QTcpSocket>
-#include <QTime>
 #include <QTimer>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 namespace flying_dragon
 {
@@ -29,7 +41,10 @@ class MessageManager : public QObject
     /// @param error The error string
     void Error (QString error);
     /// @brief An ack has been received
-    /// @param id The id of the acknowledged message
+    /// @param id The id of the newest acknowledged message
+    ///
+    /// Acks are cumulative, so every message sent before this
+    /// one has been received too.
     void ReceivedAck (quint64 id);
     /// @brief A handshake has been received
     void ReceivedHandshake ();
@@ -37,6 +52,9 @@ class MessageManager : public QObject
     void ReceivedStreamCommand (bool state);
     /// @brief A foveate command has been received
     void ReceivedFoveateCommand (bool state);
+    /// @brief A format command has been received
+    /// @param encoding The requested Frame::Encoding
+    void ReceivedFormatCommand (int encoding);
     /// @brief A disconnect command has been received
     void ReceivedDisconnectCommand ();
     /// @brief An icon has been received
@@ -47,55 +65,158 @@ class MessageManager : public QObject
     void ReceivedFixation (int x, int y, int e2);
     /// @brief Some text has been received
     void ReceivedText ();
+    /// @brief The previous frame has been handed to the
+    /// kernel, so a new frame would go out right away
+    void ReadyForFrame ();
+    /// @brief The last fragment of a frame was written
+    /// @param id The fragment's message id
+    /// @param bytes The size of the frame's messages
+    ///
+    /// An ack of this id acks the whole frame.
+    void FrameWritten (quint64 id, int bytes);
     /// @brief A message was sent
     void Sent (const Message &msg);
     /// @brief A message was received
     void Received (const Message &msg);
 
     public:
+    /// @brief Send priorities, most urgent first
+    enum Priority
+    {
+        PriorityControl,
+        PriorityGaze,
+        PriorityIcon,
+        PriorityFrame,
+        PRIORITIES,
+    };
     /// @brief Constructor
     /// @param tcp_socket Socket to send/receive messages
     MessageManager (QTcpSocket *tcp_socket)
         : tcp_socket_ (tcp_socket)
         , handshake_data_ ("FLYING_DRAGON")
         , current_message_id_ (0)
-        , message_latency_ (0)
+        , current_frame_id_ (0)
+        , frame_queued_ (false)
         , drop_icon_limit_ (1 * 1024)
-        , drop_frame_limit_ (32 * 1024)
+        , read_stage_ (ReadStageHeader)
+        , pending_data_read_ (0)
+        , fragment_size_ (0)
+        , fragment_offset_ (0)
+        , fragment_read_ (0)
+        , assembly_id_ (0)
+        , assembly_sent_ (0)
+        , assembly_read_ (0)
+        , ack_pending_ (false)
+        , ack_id_ (0)
+        , ack_timestamp_ (0)
+        , ack_received_time_ (0)
+        , flushing_ (false)
+        , low_water_fd_ (-1)
+        , fixation_pending_ (false)
+        , fixation_x_ (0)
+        , fixation_y_ (0)
+        , fixation_e2_ (0)
+        , received_fixation_pending_ (false)
+        , received_fixation_x_ (0)
+        , received_fixation_y_ (0)
+        , received_fixation_e2_ (0)
     {
         assert (tcp_socket_);
         keep_alive_timer_.setInterval (5000);
         keep_alive_timer_.start ();
+        ack_timer_.setSingleShot (true);
+        ack_timer_.setInterval (ACK_DELAY_MSECS);
         QObject::connect (tcp_socket, SIGNAL(readyRead()),
             this, SLOT(TryToRead()));
         QObject::connect (&keep_alive_timer_, SIGNAL(timeout()),
             this, SLOT(SendKeepAlive()));
+        QObject::connect (&ack_timer_, SIGNAL(timeout()),
+            this, SLOT(SendAck()));
+        QObject::connect (tcp_socket, SIGNAL(bytesWritten(qint64)),
+            this, SLOT(Flush()));
+        QObject::connect (tcp_socket, SIGNAL(disconnected()),
+            this, SLOT(ForgetLowWater()));
+        fixation_timer_.setSingleShot (true);
+        SetFixationRate (DEFAULT_FIXATION_RATE);
+        QObject::connect (&fixation_timer_, SIGNAL(timeout()),
+            this, SLOT(SendPendingFixation()));
     }
     /// @brief Get message latency
-    /// @return The latency in ms for the last message
+    /// @return The median round trip time in ms of recently
+    /// acknowledged messages
     int GetMessageLatency () const
     {
-        return message_latency_;
+        return latency_stats_.GetP50 () / 1000;
+    }
+    /// @brief Get round trip time statistics
+    ///
+    /// The samples are in microseconds.
+    const LatencyStats &GetLatencyStats () const
+    {
+        return latency_stats_;
+    }
+    /// @brief Get the estimate of the peer's clock
+    const ClockSync &GetClockSync () const
+    {
+        return clock_sync_;
+    }
+    /// @brief Get one way delays from us to the peer
+    ///
+    /// Each ack gives a sample: the time from writing the
+    /// acked message to its arrival at the peer, on our clock.
+    /// The samples are in microseconds.
+    const LatencyStats &GetUplinkStats () const
+    {
+        return uplink_stats_;
+    }
+    /// @brief Get one way delays from the peer to us
+    ///
+    /// Each received message gives a sample: the time from the
+    /// peer writing it to our reading all of it, on our clock.
+    /// The samples are in microseconds.
+    const LatencyStats &GetDownlinkStats () const
+    {
+        return downlink_stats_;
+    }
+    /// @brief Get the stage times of received frames
+    ///
+    /// Frames are timed from capture to arrival here.
+    /// Whoever decodes and paints them records the rest.
+    FrameLatency &GetFrameLatency ()
+    {
+        return frame_latency_;
+    }
+    /// @brief Get the stage times of received frames
+    const FrameLatency &GetFrameLatency () const
+    {
+        return frame_latency_;
     }
     /// @brief Send a handshake message
     void SendHandshake ()
     {
         //qDebug() << this << "sending handshake";
-        HandshakeMessage msg (NewMessageId (), handshake_data_);
+        HandshakeMessage msg (0, handshake_data_);
         Send (msg);
     }
     /// @brief Send a stream command message
     void SendStreamCommand (bool state)
     {
         //qDebug() << this << "sending stream command" << state;
-        StreamCommandMessage msg (NewMessageId (), state);
+        StreamCommandMessage msg (0, state);
         Send (msg);
     }
     /// @brief Send a foveate command message
     void SendFoveateCommand (bool state)
     {
         //qDebug() << this << "sending foveate command" << state;
-        FoveateCommandMessage msg (NewMessageId (), state);
+        FoveateCommandMessage msg (0, state);
+        Send (msg);
+    }
+    /// @brief Send a format command message
+    void SendFormatCommand (Frame::Encoding encoding)
+    {
+        //qDebug() << this << "sending format command" << encoding;
+        FormatCommandMessage msg (0, encoding);
         Send (msg);
     }
     /// @brief Send an icon message
@@ -104,28 +225,75 @@ class MessageManager : public QObject
         // Drop icons if the buffer is too full
         if (tcp_socket_->bytesToWrite () > drop_icon_limit_)
             return;
+        if (!send_queues_[PriorityIcon].isEmpty ())
+            return;
 
         //qDebug() << this << "sending icon";
-        IconMessage msg (NewMessageId (), icon);
-        Send (msg);
+        IconMessage msg (0, icon);
+        Send (msg, PriorityIcon);
     }
     /// @brief Send an frame message
+    ///
+    /// The frame is sent in fragments of at most FRAGMENT_SIZE
+    /// bytes, so more urgent messages can go out between them.
+    /// FrameWritten() is signalled when the last fragment is
+    /// written.
+    ///
+    /// Frames are never dropped here.  Callers should hold
+    /// on to their newest frame until IsReadyForFrame() says
+    /// the previous one is gone, so that a new frame never
+    /// waits behind a stale one.
     void SendFrame (const Frame &frame)
     {
-        // Drop frames if the buffer is too full
-        if (tcp_socket_->bytesToWrite () > drop_frame_limit_)
-            return;
-
         //qDebug() << this << "sending frame";
-        FrameMessage msg (NewMessageId (), frame);
-        Send (msg);
+        const quint64 frame_id = current_frame_id_++;
+        const int size = frame.GetData ().size ();
+        const int fragment_size = FRAGMENT_SIZE;
+        int offset = 0;
+        do
+        {
+            const int n = qMin (fragment_size, size - offset);
+            FrameFragmentMessage msg (0, frame_id, frame, offset, n);
+            send_queues_[PriorityFrame].enqueue (msg);
+            offset += n;
+        }
+        while (offset < size);
+        frame_queued_ = true;
+        Flush ();
+    }
+    /// @brief Determine if a new frame would go out right away
+    ///
+    /// True once every fragment of the previous frame has been
+    /// written and the socket has nothing left to write.
+    bool IsReadyForFrame () const
+    {
+        return send_queues_[PriorityFrame].isEmpty ()
+            && tcp_socket_->bytesToWrite () == 0;
+    }
+    /// @brief Set the most fixation messages sent per second
+    /// @param rate Messages per second
+    ///
+    /// Matching the frame rate or the eye tracker's sample
+    /// rate is a good choice.
+    void SetFixationRate (int rate)
+    {
+        assert (rate > 0);
+        fixation_timer_.setInterval (qMax (1, 1000 / rate));
     }
     /// @brief Send a fixation message
+    ///
+    /// Fixations are coalesced: the first one goes out right
+    /// away, and any that arrive before the fixation rate
+    /// allows another are replaced by the newest, which goes
+    /// out when the interval is up.
     void SendFixation (int x, int y, int e2)
     {
-        qDebug() << this << "sending fixation";
-        FixationMessage msg (NewMessageId (), x, y, e2);
-        Send (msg);
+        fixation_x_ = x;
+        fixation_y_ = y;
+        fixation_e2_ = e2;
+        fixation_pending_ = true;
+        if (!fixation_timer_.isActive ())
+            SendPendingFixation ();
     }
     /// @brief Send some text
     void SendText (const QByteArray &)
@@ -136,39 +304,97 @@ class MessageManager : public QObject
     }
 
     private slots:
-    /// @brief Determine if the available bytes form a message
+    /// @brief Read whatever part of the current message is
+    /// available
+    ///
+    /// The header is read once, then the data is read straight
+    /// into a buffer that was allocated when the header
+    /// arrived, so each byte is only read from the socket
+    /// once no matter how many pieces the message arrives in.
+    /// The bytes of a frame fragment are read straight into
+    /// the frame being reassembled.
     void TryToRead ()
     {
         while (tcp_socket_->bytesAvailable ())
         {
             //qDebug() << this << tcp_socket_->bytesAvailable () << "bytes available";
 
-            // Try to read a message
-            QByteArray bytes = tcp_socket_->peek (MAX_PEEK_SIZE);
-            Message msg;
-            if (!msg.Read (bytes))
-                return;
+            // Get the header
+            if (read_stage_ == ReadStageHeader)
+            {
+                if (tcp_socket_->bytesAvailable () < Message::GetHeaderSize ())
+                    return;
+                int data_size;
+                if (!pending_.ReadHeader (tcp_socket_->read (Message::GetHeaderSize ()), data_size))
+                {
+                    // There is no way to find the next message
+                    emit Error ("message_manager: invalid message header received");
+                    tcp_socket_->abort ();
+                    return;
+                }
+                fragment_size_ = 0;
+                if (pending_.GetType () == Message::TypeFrameFragment)
+                {
+                    if (data_size < Message::FRAGMENT_HEADER_SIZE)
+                    {
+                        emit Error ("message_manager: invalid frame fragment received");
+                        tcp_socket_->abort ();
+                        return;
+                    }
+                    // Only the fragment header goes in the
+                    // message data
+                    fragment_size_ = data_size - Message::FRAGMENT_HEADER_SIZE;
+                    data_size = Message::FRAGMENT_HEADER_SIZE;
+                }
+                pending_data_ = QByteArray ();
+                pending_data_.resize (data_size);
+                pending_data_read_ = 0;
+                read_stage_ = ReadStageData;
+            }
 
-            // Consume the bytes
-            tcp_socket_->read (msg.GetHeader ().size ());
-            tcp_socket_->read (msg.GetData ().size ());
+            // Get the data
+            if (read_stage_ == ReadStageData)
+            {
+                if (!ReadInto (pending_data_.data (), pending_data_.size (), pending_data_read_))
+                    return;
+                pending_.SetData (pending_data_);
+                pending_data_ = QByteArray ();
+                if (pending_.GetType () == Message::TypeFrameFragment)
+                {
+                    if (!StartFragment ())
+                    {
+                        emit Error ("message_manager: invalid frame fragment received");
+                        tcp_socket_->abort ();
+                        return;
+                    }
+                    read_stage_ = ReadStageFragment;
+                }
+            }
+
+            // Get the fragment bytes
+            if (read_stage_ == ReadStageFragment)
+            {
+                if (!ReadInto (assembly_.data () + fragment_offset_, fragment_size_, fragment_read_))
+                    return;
+                assembly_read_ += fragment_size_;
+            }
+
+            // The message is complete
+            read_stage_ = ReadStageHeader;
+            Message msg = pending_;
+            const quint64 now = MonotonicMicroseconds ();
+            if (clock_sync_.IsValid ())
+                downlink_stats_.Add (Elapsed (clock_sync_.ToLocal (msg.GetTimestamp (), now), now));
 
             //qDebug() << this << tcp_socket_->bytesAvailable () << "bytes available after reading";
             // Signal
             emit Received (msg);
             //qDebug() << this << "received" << msg.GetName (msg.GetType ());
 
-            // Don't acknowledge acks
+            // Don't acknowledge acks.  Other messages are
+            // acknowledged together a little later.
             if (msg.GetType () != Message::TypeAck)
-                SendAck (msg.GetID ());
-
-            // Calculate latency
-            if (msg.GetType () == Message::TypeAck)
-            {
-                QTime current_time = QTime::currentTime ();
-                message_latency_ = -current_time.msecsTo (msg.GetTime ());
-                //qDebug() << "message message latency: " << message_latency_;
-            }
+                QueueAck (msg);
 
             // Interpret message
             switch (msg.GetType ())
@@ -177,7 +403,35 @@ class MessageManager : public QObject
                 break;
 
                 case Message::TypeAck:
-                emit ReceivedAck (msg.GetID ());
+                {
+                    quint64 id;
+                    quint64 timestamp;
+                    quint32 delay;
+                    if (!msg.GetAck (id, timestamp, delay))
+                        emit Error ("message_manager: invalid ack received");
+                    else
+                    {
+                        // Time the newest message, leaving out
+                        // the time the peer held the ack
+                        if (in_flight_.contains (id))
+                        {
+                            const quint64 elapsed = now - in_flight_.value (id);
+                            const quint64 rtt = elapsed > delay ? elapsed - delay : 0;
+                            latency_stats_.Add (rtt);
+                            //qDebug() << "message round trip time: " << rtt;
+                        }
+                        // The ack was sent delay after the
+                        // message arrived at the peer
+                        const quint64 sent = msg.GetTimestamp ();
+                        const quint64 arrived = sent > delay ? sent - delay : 0;
+                        clock_sync_.Add (timestamp, arrived, sent, now);
+                        uplink_stats_.Add (Elapsed (timestamp, clock_sync_.ToLocal (arrived, now)));
+                        // Everything sent before it has arrived
+                        while (!in_flight_.isEmpty () && in_flight_.begin ().key () <= id)
+                            in_flight_.erase (in_flight_.begin ());
+                        emit ReceivedAck (id);
+                    }
+                }
                 break;
 
                 case Message::TypeHandshake:
@@ -202,6 +456,12 @@ class MessageManager : public QObject
                 }
                 break;
 
+                case Message::TypeFormatCommand:
+                {
+                    emit ReceivedFormatCommand (msg.GetEncoding ());
+                }
+                break;
+
                 case Message::TypeDisconnectCommand:
                 emit ReceivedDisconnectCommand ();
                 break;
@@ -218,15 +478,47 @@ class MessageManager : public QObject
                 {
                     Frame frame;
                     msg.GetFrame (frame);
-                    emit ReceivedFrame (frame);
+                    if (!frame.IsValid ())
+                        emit Error ("message_manager: invalid frame received");
+                    else
+                    {
+                        TimeFrame (frame, msg.GetTimestamp (), now);
+                        emit ReceivedFrame (frame);
+                    }
+                }
+                break;
+
+                case Message::TypeFrameFragment:
+                {
+                    if (assembly_read_ < assembly_.size ())
+                        break;
+                    // The frame shares the reassembly buffer
+                    Frame frame;
+                    frame.SetData (assembly_);
+                    assembly_ = QByteArray ();
+                    assembly_read_ = 0;
+                    if (!frame.IsValid ())
+                        emit Error ("message_manager: invalid frame received");
+                    else
+                    {
+                        TimeFrame (frame, assembly_sent_, now);
+                        emit ReceivedFrame (frame);
+                    }
                 }
                 break;
 
                 case Message::TypeFixation:
                 {
-                    int x, y, e2;
-                    msg.GetFixation (x, y, e2);
-                    emit ReceivedFixation (x, y, e2);
+                    msg.GetFixation (received_fixation_x_,
+                        received_fixation_y_,
+                        received_fixation_e2_);
+                    // Signal once all available messages
+                    // have been read
+                    if (!received_fixation_pending_)
+                    {
+                        received_fixation_pending_ = true;
+                        QTimer::singleShot (0, this, SLOT(EmitReceivedFixation()));
+                    }
                 }
                 break;
 
@@ -246,33 +538,332 @@ class MessageManager : public QObject
         if (tcp_socket_->state () == QTcpSocket::ConnectedState)
         {
             //qDebug() << this << "sending keepalive";
-            KeepAliveMessage msg (NewMessageId ());
+            KeepAliveMessage msg (0);
             Send (msg);
         }
+        // Forget messages that will never be acked, for
+        // example because the connection was reset.  Ids grow
+        // with time, so the oldest are first.
+        const quint64 now = MonotonicMicroseconds ();
+        while (!in_flight_.isEmpty () &&
+            now - in_flight_.begin ().value () > IN_FLIGHT_TIMEOUT_USECS)
+            in_flight_.erase (in_flight_.begin ());
     }
-    void SendAck (quint64 id)
+    /// @brief Hand queued messages to the socket
+    ///
+    /// Messages go out most urgent first.  Icons and frames are
+    /// only handed over once the socket has written everything
+    /// it was given.  While the kernel has KERNEL_QUEUE_LIMIT
+    /// or more bytes left to send, the next fragment is left
+    /// for the socket to write when the kernel's queue drains,
+    /// which it reports with bytesWritten().  A control or gaze
+    /// message queued behind pixels so waits for at most
+    /// KERNEL_QUEUE_LIMIT bytes plus two fragments.
+    void Flush ()
     {
+        // Writing can emit bytesWritten()
+        if (flushing_)
+            return;
+        flushing_ = true;
+        for (;;)
+        {
+            int p = 0;
+            while (p < PRIORITIES && send_queues_[p].isEmpty ())
+                ++p;
+            if (p == PRIORITIES)
+                break;
+            if (p >= PriorityIcon && tcp_socket_->bytesToWrite () > 0)
+                break;
+            if (p >= PriorityIcon && !IsKernelReady ())
+            {
+                Write (send_queues_[p].dequeue (), false);
+                break;
+            }
+            Write (send_queues_[p].dequeue ());
+        }
+        flushing_ = false;
+        if (frame_queued_ && IsReadyForFrame ())
+        {
+            frame_queued_ = false;
+            emit ReadyForFrame ();
+        }
+    }
+    /// @brief The socket's descriptor may be reused
+    void ForgetLowWater ()
+    {
+        low_water_fd_ = -1;
+    }
+    /// @brief Send the newest fixation, if there is one
+    void SendPendingFixation ()
+    {
+        if (!fixation_pending_)
+            return;
+        fixation_pending_ = false;
+        //qDebug() << this << "sending fixation";
+        FixationMessage msg (0, fixation_x_, fixation_y_, fixation_e2_);
+        Send (msg, PriorityGaze);
+        // Hold the next one back
+        fixation_timer_.start ();
+    }
+    /// @brief Pass on the newest fixation received
+    ///
+    /// Fixations that arrive together are stale except for
+    /// the newest, so only the newest is signalled.
+    void EmitReceivedFixation ()
+    {
+        if (!received_fixation_pending_)
+            return;
+        received_fixation_pending_ = false;
+        emit ReceivedFixation (received_fixation_x_, received_fixation_y_, received_fixation_e2_);
+    }
+    /// @brief Acknowledge every message received so far
+    void SendAck ()
+    {
+        if (!ack_pending_)
+            return;
+        ack_pending_ = false;
+        if (tcp_socket_->state () != QTcpSocket::ConnectedState)
+            return;
         //qDebug() << this << "sending ack";
-        QByteArray ack_data;
-        QDataStream s (&ack_data, QIODevice::WriteOnly);
-        s << id;
-        AckMessage msg (NewMessageId (), ack_data);
+        const quint64 delay = MonotonicMicroseconds () - ack_received_time_;
+        AckMessage msg (0, ack_id_, ack_timestamp_,
+            delay > 0xffffffffu ? 0xffffffffu : static_cast<quint32> (delay));
         Send (msg);
     }
 
     private:
-    void Send (const Message &msg)
+    /// @brief Read bytes into a buffer
+    /// @param p The buffer
+    /// @param size The number of bytes the buffer needs
+    /// @param done The number of bytes already read, which is
+    /// updated
+    /// @return true when the buffer is full
+    bool ReadInto (char *p, int size, int &done)
+    {
+        if (done < size)
+        {
+            const qint64 n = tcp_socket_->read (p + done, size - done);
+            if (n < 0)
+            {
+                emit Error ("message_manager: read error");
+                return false;
+            }
+            done += n;
+        }
+        return done == size;
+    }
+    /// @brief Get ready to read the bytes of a frame fragment
+    /// @return false if the fragment doesn't fit its frame
+    ///
+    /// The first fragment of a frame allocates the buffer the
+    /// frame is reassembled in.  Fragments arrive in order, so
+    /// a fragment of a new frame means any unfinished frame was
+    /// abandoned.
+    bool StartFragment ()
+    {
+        quint64 frame_id;
+        int frame_size;
+        int offset;
+        if (!pending_.GetFragment (frame_id, frame_size, offset))
+            return false;
+        if (fragment_size_ > frame_size - offset)
+            return false;
+        if (offset == 0)
+        {
+            assembly_id_ = frame_id;
+            assembly_sent_ = pending_.GetTimestamp ();
+            assembly_ = QByteArray ();
+            assembly_.resize (frame_size);
+            assembly_read_ = 0;
+        }
+        else if (frame_id != assembly_id_ ||
+            frame_size != assembly_.size () ||
+            offset != assembly_read_)
+            return false;
+        fragment_offset_ = offset;
+        fragment_read_ = 0;
+        return true;
+    }
+    /// @brief Record how long a frame took to get here
+    /// @param frame The frame
+    /// @param sent When the peer started sending it
+    /// @param now When it arrived
+    void TimeFrame (const Frame &frame, quint64 sent, quint64 now)
+    {
+        // The times can't be compared with ours until the
+        // peer's clock is known
+        if (!clock_sync_.IsValid () || frame.GetCaptureTime () == 0)
+            return;
+        frame_latency_.Received (frame.GetSequence (),
+            clock_sync_.ToLocal (frame.GetCaptureTime (), now),
+            clock_sync_.ToLocal (frame.GetEncodeTime (), now),
+            clock_sync_.ToLocal (sent, now),
+            now);
+    }
+    /// @brief Arrange for a received message to be
+    /// acknowledged
+    ///
+    /// One ack goes out at most every ACK_DELAY_MSECS, and it
+    /// covers every message received before it.
+    void QueueAck (const Message &msg)
+    {
+        ack_pending_ = true;
+        ack_id_ = msg.GetID ();
+        ack_timestamp_ = msg.GetTimestamp ();
+        ack_received_time_ = MonotonicMicroseconds ();
+        if (!ack_timer_.isActive ())
+            ack_timer_.start ();
+    }
+    /// @brief Queue a message for sending
+    /// @param msg The message
+    /// @param priority How urgent it is
+    ///
+    /// The message is given its id when it is written.
+    void Send (const Message &msg, Priority priority = PriorityControl)
     {
         assert (msg.IsValid ());
+        send_queues_[priority].enqueue (msg);
+        Flush ();
+    }
+    /// @brief Write a message to the socket
+    /// @param msg The message
+    /// @param direct Whether to try to write it right away,
+    /// or leave it for the socket to write when the kernel
+    /// wants more
+    void Write (Message msg, bool direct = true)
+    {
+        // Number it now, so that the peer's cumulative acks
+        // only cover what has really been written
+        msg.SetID (NewMessageId ());
+        // Remember when it was sent so the round trip can be
+        // timed
+        const quint64 now = MonotonicMicroseconds ();
+        msg.SetTimestamp (now);
+        if (msg.GetType () != Message::TypeAck)
+            in_flight_[msg.GetID ()] = now;
 
         // Send the message
-        tcp_socket_->write (msg.GetHeader ());
-        tcp_socket_->write (msg.GetData ());
-        tcp_socket_->flush ();
+        if (!direct || !SendDirect (msg))
+        {
+            tcp_socket_->write (msg.GetHeader ());
+            tcp_socket_->write (msg.GetData ());
+            if (msg.GetPayloadSize () != 0)
+                tcp_socket_->write (msg.GetPayload (), msg.GetPayloadSize ());
+            if (direct)
+                tcp_socket_->flush ();
+        }
         //qDebug() << this << "sent message id " << msg.GetID ();
         //qDebug() << this << tcp_socket_->bytesToWrite () << "bytes queued";
         // Signal
         emit Sent (msg);
+        if (msg.GetType () == Message::TypeFrameFragment)
+        {
+            quint64 frame_id;
+            int frame_size;
+            int offset;
+            if (msg.GetFragment (frame_id, frame_size, offset) &&
+                offset + msg.GetPayloadSize () == frame_size)
+                emit FrameWritten (msg.GetID (), Message::HEADER_SIZE + frame_size);
+        }
+    }
+    /// @brief Try to send a message without copying it
+    /// @return false if nothing was sent
+    ///
+    /// If the socket has nothing queued, the header, data, and
+    /// payload are handed to the kernel in one gather write,
+    /// straight from a stack buffer and the message's own
+    /// bytes.  Whatever the kernel does not take is queued on
+    /// the socket as usual.
+    bool SendDirect (const Message &msg)
+    {
+        // Anything already queued has to go first
+        if (tcp_socket_->bytesToWrite () != 0)
+            return false;
+        if (tcp_socket_->state () != QTcpSocket::ConnectedState)
+            return false;
+        int fd = tcp_socket_->socketDescriptor ();
+        if (fd == -1)
+            return false;
+
+        uchar header[Message::HEADER_SIZE];
+        msg.WriteHeader (header);
+        const QByteArray &data = msg.GetData ();
+        iovec iov[3];
+        iov[0].iov_base = header;
+        iov[0].iov_len = sizeof (header);
+        iov[1].iov_base = const_cast<char *> (data.constData ());
+        iov[1].iov_len = data.size ();
+        iov[2].iov_base = const_cast<char *> (msg.GetPayload ());
+        iov[2].iov_len = msg.GetPayloadSize ();
+        msghdr mh;
+        memset (&mh, 0, sizeof (mh));
+        mh.msg_iov = iov;
+        mh.msg_iovlen = 3;
+        ssize_t n;
+        do
+        {
+            n = sendmsg (fd, &mh, MSG_NOSIGNAL);
+        }
+        while (n < 0 && errno == EINTR);
+        // Let the socket deal with full buffers and errors
+        if (n <= 0)
+            return false;
+
+        // Queue the rest
+        size_t sent = n;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (sent >= iov[i].iov_len)
+            {
+                sent -= iov[i].iov_len;
+                continue;
+            }
+            tcp_socket_->write (static_cast<const char *> (iov[i].iov_base) + sent,
+                iov[i].iov_len - sent);
+            sent = 0;
+        }
+        return true;
+    }
+    /// @brief Determine if the kernel wants more bytes
+    ///
+    /// With TCP_NOTSENT_LOWAT set, a socket is only writable
+    /// while the kernel has fewer than that many bytes left to
+    /// send, and the socket's own write notification waits
+    /// for the same thing.  Without it, this only says if the
+    /// send buffer has room.
+    bool IsKernelReady ()
+    {
+        const int fd = tcp_socket_->socketDescriptor ();
+        if (fd == -1)
+            return true;
+#if defined (TCP_NOTSENT_LOWAT)
+        if (fd != low_water_fd_)
+        {
+            int limit = KERNEL_QUEUE_LIMIT;
+            setsockopt (fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &limit, sizeof (limit));
+            low_water_fd_ = fd;
+        }
+#endif
+        pollfd p;
+        p.fd = fd;
+        p.events = POLLOUT;
+        p.revents = 0;
+        int n;
+        do
+        {
+            n = poll (&p, 1, 0);
+        }
+        while (n < 0 && errno == EINTR);
+        // Let the socket deal with errors
+        return n != 0;
+    }
+    /// @brief Get the time between two readings of a clock
+    ///
+    /// Readings converted from the peer's clock can be slightly
+    /// out of order, so the time is never less than zero.
+    static quint64 Elapsed (quint64 from, quint64 to)
+    {
+        return to > from ? to - from : 0;
     }
     quint64 NewMessageId ()
     {
@@ -283,10 +874,54 @@ class MessageManager : public QObject
     QTcpSocket *tcp_socket_;
     const QByteArray handshake_data_;
     quint64 current_message_id_;
-    static const qint64 MAX_PEEK_SIZE = 1024 * 1024 * 16;
-    int message_latency_;
+    quint64 current_frame_id_;
+    bool frame_queued_;
+    static const int FRAGMENT_SIZE = 8 * 1024;
+    static const int KERNEL_QUEUE_LIMIT = 4 * FRAGMENT_SIZE;
+    static const quint64 IN_FLIGHT_TIMEOUT_USECS = 30000000;
+    static const int ACK_DELAY_MSECS = 2;
+    static const int DEFAULT_FIXATION_RATE = 60;
+    QMap<quint64, quint64> in_flight_;
+    LatencyStats latency_stats_;
+    ClockSync clock_sync_;
+    LatencyStats uplink_stats_;
+    LatencyStats downlink_stats_;
+    FrameLatency frame_latency_;
     qint64 drop_icon_limit_;
-    qint64 drop_frame_limit_;
+    enum ReadStage
+    {
+        ReadStageHeader,
+        ReadStageData,
+        ReadStageFragment,
+    };
+    ReadStage read_stage_;
+    Message pending_;
+    QByteArray pending_data_;
+    int pending_data_read_;
+    int fragment_size_;
+    int fragment_offset_;
+    int fragment_read_;
+    quint64 assembly_id_;
+    quint64 assembly_sent_;
+    QByteArray assembly_;
+    int assembly_read_;
+    QTimer ack_timer_;
+    bool ack_pending_;
+    quint64 ack_id_;
+    quint64 ack_timestamp_;
+    quint64 ack_received_time_;
+    QQueue<Message> send_queues_[PRIORITIES];
+    bool flushing_;
+    int low_water_fd_;
+    QTimer fixation_timer_;
+    bool fixation_pending_;
+    int fixation_x_;
+    int fixation_y_;
+    int fixation_e2_;
+    bool received_fixation_pending_;
+    int received_fixation_x_;
+    int received_fixation_y_;
+    int received_fixation_e2_;
 };
 
 } // namespace flying_dragon
@@ -48,20 +48,20 @@ class MessageManagerWidget : public QWidget
     void Sent (const Message &msg)
     {
         text_->appendPlainText (QString ("%1 > %2, id:%3, size:%4")
-                .arg (msg.GetTime ().toString ("hh:mm:ss.zzz"))
+                .arg (msg.GetTimestamp () / 1e6, 0, 'f', 6)
                 .arg (msg.GetName (msg.GetType ()))
                 .arg (msg.GetID ())
-                .arg (msg.GetData ().size ()));
+                .arg (msg.GetSize ()));
         ++total_sent_;
         total_sent_label_->setText (QString::number (total_sent_));
     }
     void Received (const Message &msg)
     {
         text_->appendPlainText (QString ("%1 < %2, id:%3, size:%4")
-                .arg (msg.GetTime ().toString ("hh:mm:ss.zzz"))
+                .arg (msg.GetTimestamp () / 1e6, 0, 'f', 6)
                 .arg (msg.GetName (msg.GetType ()))
                 .arg (msg.GetID ())
-                .arg (msg.GetData ().size ()));
+                .arg (msg.GetSize ()));
         ++total_received_;
         total_received_label_->setText (QString::number (total_received_));
     }
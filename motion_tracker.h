@@ -0,0 +1,136 @@
+// Motion Tracker
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 19:26:43 CDT 2026
+
+#ifndef MOTION_TRACKER_H
+#define MOTION_TRACKER_H
+
+#include "autotracker.h"
+#include "raster.h"
+#include "video_frame.h"
+#include <QObject>
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace flying_dragon
+{
+
+/// @brief Find where the motion is in captured frames
+///
+/// Runs an Autotracker on the luma of each frame, reduced to
+/// the tracker's level, and reports the fixation it settles
+/// on.  Nothing is reported while the scene is still.
+/// Connect it to the frame source before anything that
+/// encodes the frames, so each frame is foveated about the
+/// fixation found in it.
+class MotionTracker : public QObject
+{
+    Q_OBJECT
+
+    signals:
+    /// @brief A new fixation has been found
+    /// @param x Column in frame pixels
+    /// @param y Row in frame pixels
+    void NewFixation (int x, int y);
+    /// @brief Tracking has been turned off
+    void Stopped ();
+
+    public:
+    /// @brief Constructor
+    ///
+    /// Tracking starts out off.
+    MotionTracker ()
+        : enabled_ (false)
+    {
+        tracker_.set_min_energy (MIN_ENERGY);
+    }
+    /// @brief Determine if tracking is on
+    bool IsEnabled () const
+    {
+        return enabled_;
+    }
+    /// @brief Get the tracker, to change its settings
+    Autotracker<unsigned char> &GetAutotracker ()
+    {
+        return tracker_;
+    }
+
+    public slots:
+    /// @brief Turn tracking on or off
+    void SetEnabled (bool state)
+    {
+        if (state == enabled_)
+            return;
+        enabled_ = state;
+        tracker_.reset ();
+        if (!enabled_)
+            emit Stopped ();
+    }
+    /// @brief Track a frame
+    /// @param frame The frame
+    ///
+    /// Frames without YV12 planes are skipped.
+    void NewFrame (const VideoFrame &frame)
+    {
+        if (!enabled_ || !frame.HasYUV420 ())
+            return;
+        const unsigned char *y = reinterpret_cast<const unsigned char *> (frame.GetYUV420 ().constData ());
+        if (!Reduce (y, frame.GetWidth (), frame.GetHeight (), tracker_.get_level (), reduced_))
+            return;
+        int fx;
+        int fy;
+        if (tracker_.get_fixation (reduced_, fx, fy) < tracker_.get_min_energy ())
+            return;
+        emit NewFixation (fx, fy);
+    }
+
+    private:
+    /// @brief Average each 2^level square block of a plane
+    /// @return false if the plane is smaller than a block
+    static bool Reduce (const unsigned char *src,
+        int width,
+        int height,
+        size_t level,
+        jsp::raster<unsigned char> &dst)
+    {
+        assert (src);
+        const int block = 1 << level;
+        const int rows = height >> level;
+        const int cols = width >> level;
+        if (rows == 0 || cols == 0)
+            return false;
+        if (dst.rows () != static_cast<size_t> (rows) || dst.cols () != static_cast<size_t> (cols))
+            dst.resize (rows, cols, 0);
+        std::vector<unsigned> sums (cols);
+        const unsigned area = block * block;
+        for (int r = 0; r < rows; ++r)
+        {
+            std::fill (sums.begin (), sums.end (), 0);
+            for (int i = 0; i < block; ++i)
+            {
+                const unsigned char *s = src + (r * block + i) * width;
+                for (int c = 0; c < cols; ++c)
+                    for (int j = 0; j < block; ++j)
+                        sums[c] += *s++;
+            }
+            for (int c = 0; c < cols; ++c)
+                dst[r * cols + c] = static_cast<unsigned char> (sums[c] / area);
+        }
+        return true;
+    }
+
+    // A steady difference of 8 grey levels in a block
+    static const unsigned MIN_ENERGY = 64;
+    Autotracker<unsigned char> tracker_;
+    bool enabled_;
+    jsp::raster<unsigned char> reduced_;
+};
+
+} // namespace flying_dragon
+
+#endif // MOTION_TRACKER_H
@@ -0,0 +1,239 @@
+// Rate Controller
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 13:37:16 CDT 2026
+
+#ifndef RATE_CONTROLLER_H
+#define RATE_CONTROLLER_H
+
+#include <QMap>
+#include <QtGlobal>
+
+namespace flying_dragon
+{
+
+/// @brief Decide when to send frames over a connection
+///
+/// Estimates the bandwidth and round trip time of a
+/// connection from the acks of the frames sent over it, then
+/// paces frames so that they leave no faster than the link
+/// delivers them.  When the link is too slow for a reasonable
+/// frame rate, foveated frames are made smaller by shrinking
+/// e2, and e2 grows back once the link recovers.
+///
+/// The bandwidth estimate is the largest delivery rate seen
+/// recently.  A delivery rate is measured for each acked
+/// frame as the bytes that were acked while that frame was in
+/// flight divided by the time they took.  Taking the largest
+/// rate keeps the estimate from collapsing while the camera,
+/// rather than the link, limits how much is sent.
+///
+/// All times are MonotonicMicroseconds().
+class RateController
+{
+    public:
+    /// @brief Constructor
+    RateController ()
+    {
+        Reset ();
+    }
+    /// @brief Forget everything that has been measured
+    void Reset ()
+    {
+        in_flight_.clear ();
+        in_flight_bytes_ = 0;
+        delivered_ = 0;
+        delivered_time_ = 0;
+        bandwidth_ = 0.0;
+        bandwidth_time_ = 0;
+        srtt_ = 0;
+        min_rtt_ = 0;
+        min_rtt_time_ = 0;
+        frame_bytes_ = 0;
+        next_send_ = 0;
+        quality_ = MAX_QUALITY;
+    }
+    /// @brief Determine if a frame may be sent now
+    /// @param now The current time
+    bool ReadyToSend (quint64 now) const
+    {
+        // Always keep one frame moving
+        if (in_flight_bytes_ == 0)
+            return true;
+        if (now < next_send_)
+            return false;
+        return in_flight_bytes_ < GetWindow ();
+    }
+    /// @brief Get the earliest time pacing allows the next
+    /// frame to be sent
+    quint64 GetNextSendTime () const
+    {
+        return next_send_;
+    }
+    /// @brief Record that a frame was sent
+    /// @param id The frame message id
+    /// @param bytes The size of the message
+    /// @param now The current time
+    void Sent (quint64 id, int bytes, quint64 now)
+    {
+        // Don't count idle time against the link
+        if (in_flight_bytes_ == 0)
+            delivered_time_ = now;
+        Record r;
+        r.bytes = bytes;
+        r.time = now;
+        r.delivered = delivered_;
+        r.delivered_time = delivered_time_;
+        in_flight_bytes_ += bytes;
+        r.in_flight = in_flight_bytes_;
+        in_flight_[id] = r;
+        frame_bytes_ = frame_bytes_ ? (3 * frame_bytes_ + bytes) / 4 : bytes;
+        // Pace slightly faster than the estimate so that it
+        // can grow
+        if (bandwidth_ > 0.0)
+            next_send_ = now + static_cast<quint64> (
+                bytes * 100.0 / (PACING_GAIN_PERCENT * bandwidth_));
+    }
+    /// @brief Record that messages were acked
+    /// @param id The newest acked message id
+    /// @param now The current time
+    ///
+    /// Acks are cumulative, so every frame sent up to and
+    /// including this id is acked.
+    void Acked (quint64 id, quint64 now)
+    {
+        while (!in_flight_.isEmpty () && in_flight_.begin ().key () <= id)
+        {
+            const Record r = in_flight_.begin ().value ();
+            in_flight_.erase (in_flight_.begin ());
+            AckedFrame (r, now);
+        }
+    }
+    /// @brief Scale a foveation e2 parameter to fit the link
+    /// @param e2 The requested e2
+    int AdjustE2 (int e2) const
+    {
+        const int adjusted = e2 * quality_ / MAX_QUALITY;
+        return adjusted < 1 ? 1 : adjusted;
+    }
+    /// @brief Get the bandwidth estimate in bytes per second
+    double GetBandwidth () const
+    {
+        return bandwidth_ * 1000000.0;
+    }
+    /// @brief Get the smoothed round trip time in microseconds
+    quint64 GetRoundTripTime () const
+    {
+        return srtt_;
+    }
+    /// @brief Get the frame quality as a percentage
+    int GetQuality () const
+    {
+        return quality_;
+    }
+    /// @brief Get the number of unacked frame bytes
+    qint64 GetBytesInFlight () const
+    {
+        return in_flight_bytes_;
+    }
+
+    private:
+    struct Record
+    {
+        int bytes;
+        quint64 time;
+        quint64 delivered;
+        quint64 delivered_time;
+        qint64 in_flight;
+    };
+    /// @brief Record that one frame was acked
+    void AckedFrame (const Record &r, quint64 now)
+    {
+        in_flight_bytes_ -= r.bytes;
+        delivered_ += r.bytes;
+        delivered_time_ = now;
+
+        // Round trip time
+        const quint64 rtt = now - r.time;
+        srtt_ = srtt_ ? (7 * srtt_ + rtt) / 8 : rtt;
+        // Leave out the time it took to put this frame and the
+        // frames ahead of it on the link, so that our own
+        // queueing doesn't look like a long path
+        quint64 path_rtt = rtt;
+        if (bandwidth_ > 0.0)
+        {
+            const quint64 queued = static_cast<quint64> (r.in_flight / bandwidth_);
+            path_rtt = rtt > queued ? rtt - queued : 0;
+        }
+        if (min_rtt_time_ == 0 || path_rtt <= min_rtt_ || now - min_rtt_time_ > MIN_RTT_WINDOW_USECS)
+        {
+            min_rtt_ = path_rtt;
+            min_rtt_time_ = now;
+        }
+
+        // Delivery rate while this frame was in flight
+        const quint64 elapsed = now - r.delivered_time;
+        if (elapsed > 0)
+        {
+            const double rate = (delivered_ - r.delivered) / static_cast<double> (elapsed);
+            if (rate >= bandwidth_ || now - bandwidth_time_ > BANDWIDTH_WINDOW_USECS)
+            {
+                bandwidth_ = rate;
+                bandwidth_time_ = now;
+            }
+        }
+
+        UpdateQuality ();
+    }
+    /// @brief Bytes that may be in flight at once
+    ///
+    /// Twice the bandwidth-delay product, so that acks
+    /// arriving late do not stall the stream, but at least two
+    /// frames.  The minimum path round trip time is used
+    /// because the smoothed one grows with our own queueing.
+    qint64 GetWindow () const
+    {
+        const qint64 bdp = static_cast<qint64> (bandwidth_ * min_rtt_);
+        const qint64 frames = 2 * static_cast<qint64> (frame_bytes_);
+        return 2 * bdp > frames ? 2 * bdp : frames;
+    }
+    /// @brief Trade e2 for frame rate when the link is slow
+    void UpdateQuality ()
+    {
+        if (frame_bytes_ == 0 || bandwidth_ <= 0.0)
+            return;
+        const double fps = bandwidth_ * 1000000.0 / frame_bytes_;
+        if (fps < LOW_FPS && quality_ > MIN_QUALITY)
+            quality_ = quality_ - QUALITY_STEP < MIN_QUALITY ? MIN_QUALITY : quality_ - QUALITY_STEP;
+        else if (fps > HIGH_FPS && quality_ < MAX_QUALITY)
+            quality_ = quality_ + QUALITY_STEP > MAX_QUALITY ? MAX_QUALITY : quality_ + QUALITY_STEP;
+    }
+
+    static const quint64 BANDWIDTH_WINDOW_USECS = 2000000;
+    static const quint64 MIN_RTT_WINDOW_USECS = 10000000;
+    static const int LOW_FPS = 10;
+    static const int HIGH_FPS = 20;
+    static const int MIN_QUALITY = 20;
+    static const int MAX_QUALITY = 100;
+    static const int QUALITY_STEP = 5;
+    static const int PACING_GAIN_PERCENT = 125;
+    QMap<quint64, Record> in_flight_;
+    qint64 in_flight_bytes_;
+    quint64 delivered_;
+    quint64 delivered_time_;
+    double bandwidth_;
+    quint64 bandwidth_time_;
+    quint64 srtt_;
+    quint64 min_rtt_;
+    quint64 min_rtt_time_;
+    int frame_bytes_;
+    quint64 next_send_;
+    int quality_;
+};
+
+} // namespace flying_dragon
+
+#endif // RATE_CONTROLLER_H
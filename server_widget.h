@@ -25,11 +25,16 @@ namespace flying_dragon
 /// @brief Widget that controls a server
 ///
 /// The widget contains a pushbutton that starts the server
-/// listening when pressed.
+/// listening when pressed, and one that turns on motion
+/// tracking for peers that do not send fixations.
 class ServerWidget : public QToolBar
 {
     Q_OBJECT
 
+    signals:
+    /// @brief Motion tracking was turned on or off
+    void AutotrackChanged (bool state);
+
     public:
     /// @brief Constructor
     /// @param parent Parent widget
@@ -39,6 +44,7 @@ class ServerWidget : public QToolBar
         : QToolBar (parent)
         , server_ (server)
         , listen_checkbox_ (0)
+        , autotrack_checkbox_ (0)
         , port_ (0)
     {
         setObjectName (QString ("ServerWidget"));
@@ -59,6 +65,10 @@ class ServerWidget : public QToolBar
             port_->setEnabled (true);
         }
     }
+    void on_AutotrackCheckBox_stateChanged (int checked)
+    {
+        emit AutotrackChanged (checked != 0);
+    }
 
     private:
     void SetupUI ()
@@ -69,6 +79,10 @@ class ServerWidget : public QToolBar
         listen_checkbox_->setToolTip ("Listen for an incoming connection");
         listen_checkbox_->setShortcut(QKeySequence ("Ctrl+L"));
         addWidget (listen_checkbox_);
+        autotrack_checkbox_ = new QCheckBox ("Autotrack", this);
+        autotrack_checkbox_->setObjectName(QString("AutotrackCheckBox"));
+        autotrack_checkbox_->setToolTip ("Foveate about the motion for viewers that do not send fixations");
+        addWidget (autotrack_checkbox_);
         port_ = new QLineEdit ("Port", this);
         port_->setText ("7480");
         port_->setValidator (new QIntValidator (this));
@@ -78,6 +92,7 @@ class ServerWidget : public QToolBar
     }
     Server *server_;
     QCheckBox *listen_checkbox_;
+    QCheckBox *autotrack_checkbox_;
     QLineEdit *port_;
 };
 
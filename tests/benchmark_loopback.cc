@@ -0,0 +1,73 @@
+// Loopback Benchmark
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 18:41:07 CDT 2026
+
+#include "argv.h"
+#include "benchmark_loopback.h"
+#include "exception_enabled_app.h"
+#include <iostream>
+#include <stdexcept>
+
+using namespace flying_dragon;
+using namespace std;
+using namespace jsp;
+
+int main (int argc, char **argv)
+{
+    try
+    {
+        ExceptionEnabledCoreApplication app (argc, argv);
+
+        bool help = false;
+        int clients = 4;
+        int width = 320;
+        int height = 240;
+        int fps = 30;
+        int seconds = 5;
+        bool foveated = false;
+        CommandLine cl;
+        cl.AddSpec ("help", 'h', help, "Print help message");
+        cl.AddSpec ("clients", 'c', clients, "Number of clients");
+        cl.AddSpec ("width", 'x', width, "Frame width");
+        cl.AddSpec ("height", 'y', height, "Frame height");
+        cl.AddSpec ("fps", 'f', fps, "Frame rate, 0 for as fast as possible");
+        cl.AddSpec ("seconds", 's', seconds, "How long to measure");
+        cl.AddSpec ("foveated", 'v', foveated, "Send foveated frames");
+        cl.GroupArgs (argc, argv, 1);
+        cl.ExtractBegin ();
+        cl.Extract (help);
+        cl.Extract (clients);
+        cl.Extract (width);
+        cl.Extract (height);
+        cl.Extract (fps);
+        cl.Extract (seconds);
+        cl.Extract (foveated);
+        cl.ExtractEnd ();
+
+        if (help)
+        {
+            cout << argv[0] << " " << cl.Usage () << endl;
+            cout << cl.Help ();
+            return 0;
+        }
+        if (!cl.GetLeftOverArgs ().empty ())
+            throw runtime_error ("usage: " + string (argv[0]) + " " + cl.Usage ());
+        if (clients < 1 || width < 2 || height < 2 || fps < 0 || seconds < 1)
+            throw runtime_error ("invalid benchmark settings");
+
+        Benchmark benchmark (clients, seconds, foveated);
+        benchmark.Start (width, height, fps);
+        const int status = app.exec ();
+        // An exception quits the event loop without an error
+        return benchmark.IsFinished () ? status : -1;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
@@ -0,0 +1,176 @@
+// Loopback Benchmark
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 18:41:07 CDT 2026
+
+#include "camera_controller.h"
+#include "clock.h"
+#include "connection_manager.h"
+#include "latency_stats.h"
+#include "server.h"
+#include <QCoreApplication>
+#include <QObject>
+#include <QTimer>
+#include <iostream>
+#include <sys/resource.h>
+
+using namespace flying_dragon;
+using namespace std;
+
+/// @brief Stream synthetic frames to clients on this host
+///
+/// Frames go from a synthetic capture source through a
+/// Server to each client connection and are decoded there,
+/// so every stage a real frame goes through is measured.
+/// The server and the clients share a process, and so a
+/// clock, which makes capture to decode latencies exact.
+class Benchmark : public QObject
+{
+    Q_OBJECT
+
+    public:
+    /// @brief Constructor
+    /// @param clients Number of clients
+    /// @param seconds How long to measure
+    /// @param foveated Whether the clients ask for foveated
+    /// frames
+    Benchmark (int clients, int seconds, bool foveated)
+        : server_ (server_manager_)
+        , clients_ (clients)
+        , seconds_ (seconds)
+        , foveated_ (foveated)
+        , streaming_ (0)
+        , measuring_ (false)
+        , finished_ (false)
+        , frames_ (0)
+        , bytes_ (0)
+        , latency_ (MAX_SAMPLES)
+        , start_time_ (0)
+        , start_cpu_ (0)
+    {
+        QObject::connect (&camera_controller_, SIGNAL(NewIcon (const QImage &)),
+            &server_manager_, SLOT(NewIcon (const QImage &)));
+        QObject::connect (&camera_controller_, SIGNAL(NewVideoFrame (const VideoFrame &)),
+            &server_manager_, SLOT(NewFrame (const VideoFrame &)));
+        QObject::connect (&client_manager_, SIGNAL(Added(const Connection *)),
+            this, SLOT(Added(const Connection *)));
+    }
+    /// @brief Start streaming
+    /// @param width Frame width
+    /// @param height Frame height
+    /// @param fps Frame rate, or 0 for as fast as possible
+    void Start (unsigned width, unsigned height, unsigned fps)
+    {
+        camera_controller_.Open ("synthetic", width, height, fps);
+        camera_controller_.StartCapture ();
+        // Let the system pick a free port
+        server_.Listen (0);
+        for (int i = 0; i < clients_; ++i)
+            client_manager_.ConnectToServer ("127.0.0.1", server_.serverPort ());
+        QTimer::singleShot (START_TIMEOUT_SECS * 1000, this, SLOT(StartTimeout()));
+    }
+    /// @brief Determine if a full measurement was made
+    bool IsFinished () const
+    {
+        return finished_;
+    }
+
+    private slots:
+    void Added (const Connection *connection)
+    {
+        QObject::connect (connection, SIGNAL(StateChanged()),
+            this, SLOT(StateChanged()));
+        QObject::connect (connection, SIGNAL(ReceivedFrame(const Frame &)),
+            this, SLOT(ReceivedFrame(const Frame &)));
+    }
+    void StateChanged ()
+    {
+        const Connection *c = qobject_cast<const Connection *> (QObject::sender ());
+        if (!c || c->GetState () != Connection::StateConnected)
+            return;
+        Connection *connection = client_manager_.Find (c->GetID ());
+        connection->SendFoveateCommand (foveated_);
+        connection->SendStreamCommand (true);
+        // Measure once every client is streaming
+        if (++streaming_ == clients_)
+        {
+            measuring_ = true;
+            start_time_ = MonotonicMicroseconds ();
+            start_cpu_ = CPUMicroseconds ();
+            QTimer::singleShot (seconds_ * 1000, this, SLOT(Finish()));
+        }
+    }
+    void ReceivedFrame (const Frame &frame)
+    {
+        if (!measuring_)
+            return;
+        QImage image = frame.Decode ();
+        const quint64 now = MonotonicMicroseconds ();
+        if (image.isNull ())
+            return;
+        ++frames_;
+        bytes_ += frame.GetData ().size ();
+        latency_.Add (now > frame.GetCaptureTime () ? now - frame.GetCaptureTime () : 0);
+    }
+    void StartTimeout ()
+    {
+        if (measuring_)
+            return;
+        cerr << "only " << streaming_ << " of " << clients_
+            << " clients started streaming" << endl;
+        QCoreApplication::exit (-1);
+    }
+    void Finish ()
+    {
+        measuring_ = false;
+        const double secs = (MonotonicMicroseconds () - start_time_) / 1e6;
+        const quint64 cpu = CPUMicroseconds () - start_cpu_;
+        camera_controller_.StopCapture ();
+        cout << "clients " << clients_ << endl;
+        cout << "width " << camera_controller_.GetWidth () << endl;
+        cout << "height " << camera_controller_.GetHeight () << endl;
+        cout << "seconds " << secs << endl;
+        cout << "frames " << frames_ << endl;
+        cout << "fps_per_client " << frames_ / secs / clients_ << endl;
+        cout << "bytes_per_sec " << static_cast<quint64> (bytes_ / secs) << endl;
+        cout << "cpu_usecs_per_frame " << (frames_ ? cpu / frames_ : 0) << endl;
+        cout << "latency_min_usecs " << latency_.GetMin () << endl;
+        cout << "latency_mean_usecs " << latency_.GetMean () << endl;
+        cout << "latency_p50_usecs " << latency_.GetP50 () << endl;
+        cout << "latency_p99_usecs " << latency_.GetP99 () << endl;
+        finished_ = frames_ != 0;
+        QCoreApplication::exit (finished_ ? 0 : -1);
+    }
+
+    private:
+    /// @brief Get the user and system time used by this
+    /// process
+    static quint64 CPUMicroseconds ()
+    {
+        rusage r;
+        getrusage (RUSAGE_SELF, &r);
+        return (r.ru_utime.tv_sec + r.ru_stime.tv_sec) * 1000000ULL
+            + r.ru_utime.tv_usec + r.ru_stime.tv_usec;
+    }
+
+    static const int MAX_SAMPLES = 100000;
+    static const int START_TIMEOUT_SECS = 10;
+    CameraController camera_controller_;
+    ConnectionManager server_manager_;
+    ConnectionManager client_manager_;
+    Server server_;
+    int clients_;
+    int seconds_;
+    bool foveated_;
+    int streaming_;
+    bool measuring_;
+    bool finished_;
+    quint64 frames_;
+    quint64 bytes_;
+    LatencyStats latency_;
+    quint64 start_time_;
+    quint64 start_cpu_;
+};
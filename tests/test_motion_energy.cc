@@ -0,0 +1,158 @@
+// Test Motion Energy
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 21:14:08 CDT 2026
+
+#include "autotracker.h"
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace flying_dragon;
+using namespace std;
+
+/// @brief Sweep a frame with the vector path and the scalar
+/// tail, the way Autotracker does
+void SweepBoth (const vector<unsigned char> &f,
+    vector<unsigned char> &last,
+    vector<unsigned short> &energy,
+    unsigned shift,
+    int &best,
+    size_t &best_index)
+{
+    const size_t n = f.size ();
+    const size_t done = motion_energy::SweepSIMD (&f[0], &last[0], &energy[0], shift, n, best, best_index);
+    if (done > n || done % 16 != 0)
+        throw runtime_error ("the vector path swept a partial block");
+    motion_energy::Sweep (&f[0], &last[0], &energy[0], shift, done, n, best, best_index);
+}
+
+/// @brief Sweep a frame with the scalar path only
+void SweepScalar (const vector<unsigned char> &f,
+    vector<unsigned char> &last,
+    vector<unsigned short> &energy,
+    unsigned shift,
+    int &best,
+    size_t &best_index)
+{
+    motion_energy::Sweep (&f[0], &last[0], &energy[0], shift, 0, f.size (), best, best_index);
+}
+
+/// @brief Make the next frame
+/// @param f The frame
+/// @param last The last frame
+/// @param kind How to change it
+///
+/// Kind 0 changes a few random pixels, kind 1 changes every
+/// pixel the same way so that every energy ties, and kind 2
+/// changes every 16th pixel the same way so that the ties
+/// fall in different blocks.  Kind 3 changes nothing.
+void NextFrame (vector<unsigned char> &f, const vector<unsigned char> &last, int kind)
+{
+    const unsigned char step = static_cast<unsigned char> (1 + rand () % 255);
+    for (size_t i = 0; i < f.size (); ++i)
+    {
+        switch (kind)
+        {
+            case 0:
+            f[i] = rand () % 4 == 0 ? static_cast<unsigned char> (rand ()) : last[i];
+            break;
+            case 1:
+            f[i] = static_cast<unsigned char> (last[i] + step);
+            break;
+            case 2:
+            f[i] = i % 16 == 7 ? static_cast<unsigned char> (last[i] + step) : last[i];
+            break;
+            default:
+            f[i] = last[i];
+        }
+    }
+}
+
+/// @brief Check that both paths agree
+/// @param trial Trial number, for the message
+/// @param n Pixels in a frame
+/// @param shift The decay shift
+/// @param frames Frames to sweep
+void Check (int trial, size_t n, unsigned shift, int frames)
+{
+    vector<unsigned char> f (n);
+    vector<unsigned char> last1 (n);
+    vector<unsigned short> energy1 (n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        last1[i] = static_cast<unsigned char> (rand ());
+        energy1[i] = trial % 3 == 0 ? 0 : static_cast<unsigned short> (rand () % 65536);
+    }
+    vector<unsigned char> last2 (last1);
+    vector<unsigned short> energy2 (energy1);
+    for (int i = 0; i < frames; ++i)
+    {
+        NextFrame (f, last1, rand () % 4);
+        int best1 = -1;
+        size_t best_index1 = 0;
+        SweepBoth (f, last1, energy1, shift, best1, best_index1);
+        int best2 = -1;
+        size_t best_index2 = 0;
+        SweepScalar (f, last2, energy2, shift, best2, best_index2);
+        if (energy1 != energy2 || last1 != last2 || last1 != f
+            || best1 != best2 || best_index1 != best_index2)
+        {
+            ostringstream s;
+            s << "trial " << trial << " frame " << i
+                << " with " << n << " pixels and shift " << shift
+                << ": vector path found " << best1 << " at " << best_index1
+                << ", scalar path found " << best2 << " at " << best_index2;
+            throw runtime_error (s.str ());
+        }
+    }
+}
+
+/// @brief Check that a still scene loses all its energy
+void CheckDecay (unsigned shift)
+{
+    const size_t n = 37;
+    vector<unsigned char> f (n, 7);
+    vector<unsigned char> last (f);
+    vector<unsigned short> energy (n, motion_energy::MAX_ENERGY);
+    // Each frame takes at least 1 from every nonzero energy
+    for (unsigned i = 0; i <= motion_energy::MAX_ENERGY; ++i)
+    {
+        int best = -1;
+        size_t best_index = 0;
+        SweepBoth (f, last, energy, shift, best, best_index);
+        if (best == 0)
+            return;
+    }
+    ostringstream s;
+    s << "energy never decayed to 0 with shift " << shift;
+    throw runtime_error (s.str ());
+}
+
+int main ()
+{
+    try
+    {
+        srand (1);
+        // Sizes around and between the vector width
+        for (int trial = 0; trial < 400; ++trial)
+        {
+            const size_t n = trial < 64 ? 1 + trial : 1 + rand () % 3000;
+            const unsigned shift = 1 + rand () % 15;
+            Check (trial, n, shift, 8);
+        }
+        for (unsigned shift = 1; shift <= 15; ++shift)
+            CheckDecay (shift);
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << "exception: " << e.what () << endl;
+        return -1;
+    }
+}
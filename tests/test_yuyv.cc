@@ -0,0 +1,132 @@
+// Test YUYV Conversion
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 21:32:51 CDT 2026
+
+#include "yuyv.h"
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace flying_dragon;
+using namespace std;
+
+/// @brief Fill a buffer with random bytes
+void Randomize (vector<unsigned char> &v)
+{
+    for (size_t i = 0; i < v.size (); ++i)
+        v[i] = static_cast<unsigned char> (rand ());
+}
+
+/// @brief Check that the vector row kernel and the scalar
+/// tail agree with the scalar kernel alone
+/// @param width Row width, even
+void CheckRow (unsigned width)
+{
+    vector<unsigned char> s (width * 2 + 1);
+    Randomize (s);
+    // Extremes, so the clamps are exercised
+    if (width >= 4)
+    {
+        s[0] = 0;
+        s[1] = 255;
+        s[2] = 255;
+        s[3] = 0;
+    }
+    vector<quint32> d1 (width + 1, 0);
+    vector<unsigned char> y1 (width + 1, 0);
+    const unsigned done = yuyv::ConvertRowSIMD (&s[0], width, &d1[0], &y1[0]);
+    if (done > width)
+        throw runtime_error ("the vector path converted past the end of the row");
+    yuyv::ConvertRow (&s[0], done, width, &d1[0], &y1[0]);
+    vector<quint32> d2 (width + 1, 0);
+    vector<unsigned char> y2 (width + 1, 0);
+    yuyv::ConvertRow (&s[0], 0, width, &d2[0], &y2[0]);
+    if (d1 != d2 || y1 != y2)
+    {
+        ostringstream o;
+        o << "vector and scalar paths differ for a " << width << " pixel row";
+        throw runtime_error (o.str ());
+    }
+}
+
+/// @brief Check a whole frame against the scalar kernel
+void CheckFrame (unsigned width, unsigned height)
+{
+    vector<unsigned char> src (width * height * 2);
+    Randomize (src);
+    vector<unsigned char> rgb32 (width * height * 4);
+    vector<unsigned char> y (width * height);
+    vector<unsigned char> u ((width / 2) * (height / 2));
+    vector<unsigned char> v ((width / 2) * (height / 2));
+    YUYV2RGB32 (&src[0], width, height, &rgb32[0], &y[0], &u[0], &v[0]);
+    vector<quint32> row (width);
+    vector<unsigned char> yrow (width);
+    for (unsigned r = 0; r < height; ++r)
+    {
+        yuyv::ConvertRow (&src[r * width * 2], 0, width, &row[0], &yrow[0]);
+        for (unsigned i = 0; i < width; ++i)
+        {
+            const unsigned char *p = &rgb32[(r * width + i) * 4];
+            const quint32 pixel = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<quint32> (p[3]) << 24);
+            if (pixel != row[i] || y[r * width + i] != yrow[i])
+            {
+                ostringstream o;
+                o << "frame " << width << "x" << height
+                    << " differs at row " << r << " column " << i;
+                throw runtime_error (o.str ());
+            }
+        }
+    }
+    // Converting the planes back uses the same kernel
+    if (height % 2 == 0)
+    {
+        vector<unsigned char> planes (width * height * 4);
+        YV122RGB32 (&y[0], &u[0], &v[0], width, height, &planes[0]);
+        // Chroma was averaged, so only check frames of one
+        // repeated row pair
+        vector<unsigned char> flat (src);
+        for (unsigned r = 0; r < height; ++r)
+            for (unsigned i = 0; i < width * 2; ++i)
+                flat[r * width * 2 + i] = src[i];
+        YUYV2RGB32 (&flat[0], width, height, &rgb32[0], &y[0], &u[0], &v[0]);
+        YV122RGB32 (&y[0], &u[0], &v[0], width, height, &planes[0]);
+        if (planes != rgb32)
+        {
+            ostringstream o;
+            o << "frame " << width << "x" << height
+                << " changed color going through the planes";
+            throw runtime_error (o.str ());
+        }
+    }
+}
+
+int main ()
+{
+    try
+    {
+        srand (1);
+        // Every width up to a few vector widths, to cover the
+        // tails of both the SSE2 and the AVX2 paths
+        for (unsigned width = 0; width <= 70; width += 2)
+            for (int trial = 0; trial < 20; ++trial)
+                CheckRow (width);
+        for (int trial = 0; trial < 200; ++trial)
+            CheckRow (2 * (rand () % 1000));
+        CheckFrame (2, 2);
+        CheckFrame (18, 5);
+        CheckFrame (322, 240);
+        CheckFrame (640, 480);
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << "exception: " << e.what () << endl;
+        return -1;
+    }
+}
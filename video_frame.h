@@ -0,0 +1,102 @@
+// Video Frame
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 11:02:19 CDT 2026
+
+#ifndef VIDEO_FRAME_H
+#define VIDEO_FRAME_H
+
+#include <QByteArray>
+#include <QImage>
+#include <cassert>
+
+namespace flying_dragon
+{
+
+/// @brief A captured video frame
+///
+/// Holds the RGB32 image used for display along with the
+/// YV12 planes the camera delivered.  Both are implicitly
+/// shared, so copying a video frame does not copy pixels.
+class VideoFrame
+{
+    public:
+    /// @brief Constructor
+    VideoFrame ()
+        : sequence_ (0)
+        , capture_time_ (0)
+    {
+    }
+    /// @brief Constructor
+    /// @param image The RGB32 image
+    /// @param yuv420 The Y plane followed by the U and V
+    /// planes, or an empty array if there are no planes
+    /// @param sequence The frame's sequence number
+    /// @param capture_time When the frame was captured, in
+    /// MonotonicMicroseconds()
+    VideoFrame (const QImage &image, const QByteArray &yuv420,
+        quint32 sequence = 0, quint64 capture_time = 0)
+        : image_ (image)
+        , yuv420_ (yuv420)
+        , sequence_ (sequence)
+        , capture_time_ (capture_time)
+    {
+        assert (yuv420_.isEmpty () ||
+            yuv420_.size () == YUV420Size (image_.width (), image_.height ()));
+    }
+    /// @brief Get the RGB32 image
+    const QImage &GetImage () const
+    {
+        return image_;
+    }
+    /// @brief Get the frame width
+    int GetWidth () const
+    {
+        return image_.width ();
+    }
+    /// @brief Get the frame height
+    int GetHeight () const
+    {
+        return image_.height ();
+    }
+    /// @brief Determine if the frame has YV12 planes
+    bool HasYUV420 () const
+    {
+        return !yuv420_.isEmpty ();
+    }
+    /// @brief Get the YV12 planes
+    const QByteArray &GetYUV420 () const
+    {
+        return yuv420_;
+    }
+    /// @brief Get the frame's sequence number
+    quint32 GetSequence () const
+    {
+        return sequence_;
+    }
+    /// @brief Get when the frame was captured
+    quint64 GetCaptureTime () const
+    {
+        return capture_time_;
+    }
+    /// @brief Get the size of a set of YV12 planes
+    /// @param w Frame width
+    /// @param h Frame height
+    static int YUV420Size (int w, int h)
+    {
+        return w * h + 2 * (w / 2) * (h / 2);
+    }
+
+    private:
+    QImage image_;
+    QByteArray yuv420_;
+    quint32 sequence_;
+    quint64 capture_time_;
+};
+
+} // namespace flying_dragon
+
+#endif // VIDEO_FRAME_H
@@ -0,0 +1,304 @@
+// YUYV Conversion Functions
+//
+// Copyright (C) 2026
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// jsp Sat Oct 17 10:12:44 CDT 2026
+
+#ifndef YUYV_H
+#define YUYV_H
+
+#include <QtGlobal>
+#include <cassert>
+#include <vector>
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace flying_dragon
+{
+
+/// @brief YUYV to RGB32 conversion coefficients
+///
+/// BT.601 studio swing.  Each term is computed as
+/// ((x << 7) * k) >> 16, which is exactly what
+/// _mm_mulhi_epi16 computes, so the scalar and vector
+/// paths give identical results.
+namespace yuyv
+{
+    const int KY = 597;
+    const int KRV = 817;
+    const int KGU = 200;
+    const int KGV = 416;
+    const int KBU = 1033;
+
+    inline int MulHi (int x, int k)
+    {
+        return (x * k) >> 16;
+    }
+    inline unsigned Clamp (int x)
+    {
+        return x < 0 ? 0 : (x > 255 ? 255 : x);
+    }
+    /// @brief Convert one row, scalar version
+    inline void ConvertRow (const unsigned char *s,
+        unsigned begin,
+        unsigned end,
+        quint32 *d,
+        unsigned char *y)
+    {
+        assert (begin % 2 == 0);
+        assert (end % 2 == 0);
+        for (unsigned i = begin; i < end; i += 2)
+        {
+            const unsigned char *p = s + 2 * i;
+            const int du = (p[1] - 128) * 128;
+            const int dv = (p[3] - 128) * 128;
+            const int r = MulHi (dv, KRV);
+            const int g = MulHi (du, KGU) + MulHi (dv, KGV);
+            const int b = MulHi (du, KBU);
+            for (unsigned j = 0; j < 2; ++j)
+            {
+                const int l = MulHi ((p[2 * j] - 16) * 128, KY);
+                d[i + j] = 0xff000000u |
+                    (Clamp (l + r) << 16) |
+                    (Clamp (l - g) << 8) |
+                    Clamp (l + b);
+                if (y)
+                    y[i + j] = p[2 * j];
+            }
+        }
+    }
+#if defined (__AVX2__)
+    /// @brief Convert one row, 16 pixels at a time
+    /// @return The number of pixels converted
+    inline unsigned ConvertRowSIMD (const unsigned char *s,
+        unsigned width,
+        quint32 *d,
+        unsigned char *y)
+    {
+        const __m256i mask = _mm256_set1_epi16 (0x00ff);
+        const __m256i c16 = _mm256_set1_epi16 (16);
+        const __m256i c128 = _mm256_set1_epi16 (128);
+        const __m256i ky = _mm256_set1_epi16 (KY);
+        const __m256i krv = _mm256_set1_epi16 (KRV);
+        const __m256i kgu = _mm256_set1_epi16 (KGU);
+        const __m256i kgv = _mm256_set1_epi16 (KGV);
+        const __m256i kbu = _mm256_set1_epi16 (KBU);
+        const __m256i alpha = _mm256_set1_epi8 (-1);
+        unsigned i = 0;
+        for (; i + 16 <= width; i += 16)
+        {
+            const __m256i p = _mm256_loadu_si256 (reinterpret_cast<const __m256i *> (s + 2 * i));
+            const __m256i l = _mm256_and_si256 (p, mask);
+            // U0 V0 U1 V1 ... within each 128 bit lane
+            const __m256i uv = _mm256_srli_epi16 (p, 8);
+            const __m256i u = _mm256_shufflehi_epi16 (
+                _mm256_shufflelo_epi16 (uv, _MM_SHUFFLE (2, 2, 0, 0)), _MM_SHUFFLE (2, 2, 0, 0));
+            const __m256i v = _mm256_shufflehi_epi16 (
+                _mm256_shufflelo_epi16 (uv, _MM_SHUFFLE (3, 3, 1, 1)), _MM_SHUFFLE (3, 3, 1, 1));
+            if (y)
+            {
+                const __m256i l8 = _mm256_permute4x64_epi64 (_mm256_packus_epi16 (l, l), 0x08);
+                _mm_storeu_si128 (reinterpret_cast<__m128i *> (y + i), _mm256_castsi256_si128 (l8));
+            }
+            const __m256i cl = _mm256_mulhi_epi16 (_mm256_slli_epi16 (_mm256_sub_epi16 (l, c16), 7), ky);
+            const __m256i du = _mm256_slli_epi16 (_mm256_sub_epi16 (u, c128), 7);
+            const __m256i dv = _mm256_slli_epi16 (_mm256_sub_epi16 (v, c128), 7);
+            const __m256i r = _mm256_add_epi16 (cl, _mm256_mulhi_epi16 (dv, krv));
+            const __m256i g = _mm256_sub_epi16 (cl, _mm256_add_epi16 (
+                _mm256_mulhi_epi16 (du, kgu), _mm256_mulhi_epi16 (dv, kgv)));
+            const __m256i b = _mm256_add_epi16 (cl, _mm256_mulhi_epi16 (du, kbu));
+            // Interleave into B G R A bytes
+            const __m256i bg = _mm256_unpacklo_epi8 (_mm256_packus_epi16 (b, b), _mm256_packus_epi16 (g, g));
+            const __m256i ra = _mm256_unpacklo_epi8 (_mm256_packus_epi16 (r, r), alpha);
+            const __m256i lo = _mm256_unpacklo_epi16 (bg, ra);
+            const __m256i hi = _mm256_unpackhi_epi16 (bg, ra);
+            _mm256_storeu_si256 (reinterpret_cast<__m256i *> (d + i), _mm256_permute2x128_si256 (lo, hi, 0x20));
+            _mm256_storeu_si256 (reinterpret_cast<__m256i *> (d + i + 8), _mm256_permute2x128_si256 (lo, hi, 0x31));
+        }
+        return i;
+    }
+#elif defined (__SSE2__)
+    /// @brief Convert one row, 8 pixels at a time
+    /// @return The number of pixels converted
+    inline unsigned ConvertRowSIMD (const unsigned char *s,
+        unsigned width,
+        quint32 *d,
+        unsigned char *y)
+    {
+        const __m128i mask = _mm_set1_epi16 (0x00ff);
+        const __m128i c16 = _mm_set1_epi16 (16);
+        const __m128i c128 = _mm_set1_epi16 (128);
+        const __m128i ky = _mm_set1_epi16 (KY);
+        const __m128i krv = _mm_set1_epi16 (KRV);
+        const __m128i kgu = _mm_set1_epi16 (KGU);
+        const __m128i kgv = _mm_set1_epi16 (KGV);
+        const __m128i kbu = _mm_set1_epi16 (KBU);
+        const __m128i alpha = _mm_set1_epi8 (-1);
+        unsigned i = 0;
+        for (; i + 8 <= width; i += 8)
+        {
+            const __m128i p = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (s + 2 * i));
+            const __m128i l = _mm_and_si128 (p, mask);
+            // U0 V0 U1 V1 U2 V2 U3 V3
+            const __m128i uv = _mm_srli_epi16 (p, 8);
+            const __m128i u = _mm_shufflehi_epi16 (
+                _mm_shufflelo_epi16 (uv, _MM_SHUFFLE (2, 2, 0, 0)), _MM_SHUFFLE (2, 2, 0, 0));
+            const __m128i v = _mm_shufflehi_epi16 (
+                _mm_shufflelo_epi16 (uv, _MM_SHUFFLE (3, 3, 1, 1)), _MM_SHUFFLE (3, 3, 1, 1));
+            if (y)
+                _mm_storel_epi64 (reinterpret_cast<__m128i *> (y + i), _mm_packus_epi16 (l, l));
+            const __m128i cl = _mm_mulhi_epi16 (_mm_slli_epi16 (_mm_sub_epi16 (l, c16), 7), ky);
+            const __m128i du = _mm_slli_epi16 (_mm_sub_epi16 (u, c128), 7);
+            const __m128i dv = _mm_slli_epi16 (_mm_sub_epi16 (v, c128), 7);
+            const __m128i r = _mm_add_epi16 (cl, _mm_mulhi_epi16 (dv, krv));
+            const __m128i g = _mm_sub_epi16 (cl, _mm_add_epi16 (
+                _mm_mulhi_epi16 (du, kgu), _mm_mulhi_epi16 (dv, kgv)));
+            const __m128i b = _mm_add_epi16 (cl, _mm_mulhi_epi16 (du, kbu));
+            // Interleave into B G R A bytes
+            const __m128i bg = _mm_unpacklo_epi8 (_mm_packus_epi16 (b, b), _mm_packus_epi16 (g, g));
+            const __m128i ra = _mm_unpacklo_epi8 (_mm_packus_epi16 (r, r), alpha);
+            _mm_storeu_si128 (reinterpret_cast<__m128i *> (d + i), _mm_unpacklo_epi16 (bg, ra));
+            _mm_storeu_si128 (reinterpret_cast<__m128i *> (d + i + 4), _mm_unpackhi_epi16 (bg, ra));
+        }
+        return i;
+    }
+#else
+    inline unsigned ConvertRowSIMD (const unsigned char *,
+        unsigned,
+        quint32 *,
+        unsigned char *)
+    {
+        return 0;
+    }
+#endif
+} // namespace yuyv
+
+/// @brief Convert a YUYV frame to RGB32 in a single pass
+/// @param src Packed YUYV pixels
+/// @param width Frame width, must be even
+/// @param height Frame height
+/// @param rgb32 Destination for width * height RGB32
+/// pixels, in QImage::Format_RGB32 layout
+/// @param y Optional destination for the width * height
+/// luminance plane
+/// @param u Optional destination for the (width / 2) *
+/// (height / 2) U plane
+/// @param v Optional destination for the (width / 2) *
+/// (height / 2) V plane
+/// @param icon Optional destination for an icon_width *
+/// icon_height RGB32 icon
+/// @param icon_width Icon width
+/// @param icon_height Icon height
+///
+/// The chroma planes are the average of each pair of rows,
+/// as in YV12.  The icon is point sampled from each
+/// converted row while the row is still in cache.
+///
+/// The vector path is chosen at compile time.  Build with
+/// -mavx2 to get the AVX2 path, SSE2 is used otherwise on
+/// x86-64.
+inline void YUYV2RGB32 (const unsigned char *src,
+    unsigned width,
+    unsigned height,
+    unsigned char *rgb32,
+    unsigned char *y = 0,
+    unsigned char *u = 0,
+    unsigned char *v = 0,
+    unsigned char *icon = 0,
+    unsigned icon_width = 0,
+    unsigned icon_height = 0)
+{
+    assert (src);
+    assert (rgb32);
+    assert (width % 2 == 0);
+    assert ((u == 0) == (v == 0));
+    assert (!icon || (icon_width != 0 && icon_height != 0));
+    quint32 *d = reinterpret_cast<quint32 *> (rgb32);
+    quint32 *icon_row = reinterpret_cast<quint32 *> (icon);
+    unsigned next_icon_row = 0;
+    for (unsigned row = 0; row < height; ++row)
+    {
+        const unsigned char *s = src + row * width * 2;
+        unsigned char *yrow = y ? y + row * width : 0;
+        const unsigned done = yuyv::ConvertRowSIMD (s, width, d, yrow);
+        yuyv::ConvertRow (s, done, width, d, yrow);
+        // Average the chroma of this row pair
+        if (u && row % 2 == 1)
+        {
+            const unsigned char *s0 = s - width * 2;
+            unsigned char *urow = u + (row / 2) * (width / 2);
+            unsigned char *vrow = v + (row / 2) * (width / 2);
+            for (unsigned i = 0; i < width / 2; ++i)
+            {
+                urow[i] = static_cast<unsigned char> ((s0[4 * i + 1] + s[4 * i + 1] + 1) >> 1);
+                vrow[i] = static_cast<unsigned char> ((s0[4 * i + 3] + s[4 * i + 3] + 1) >> 1);
+            }
+        }
+        // Sample the icon rows that map to this row
+        while (icon && next_icon_row < icon_height
+            && next_icon_row * height / icon_height == row)
+        {
+            for (unsigned i = 0; i < icon_width; ++i)
+                icon_row[i] = d[i * width / icon_width];
+            icon_row += icon_width;
+            ++next_icon_row;
+        }
+        d += width;
+    }
+}
+
+/// @brief Convert YV12 planes to RGB32
+/// @param y The width * height luminance plane
+/// @param u The (width / 2) * (height / 2) U plane
+/// @param v The (width / 2) * (height / 2) V plane
+/// @param width Frame width, must be even
+/// @param height Frame height, must be even
+/// @param rgb32 Destination for width * height RGB32
+/// pixels, in QImage::Format_RGB32 layout
+///
+/// Each row is interleaved back into YUYV and converted
+/// with the same row kernel YUYV2RGB32() uses, so a frame
+/// that makes a round trip through the planes decodes to
+/// the same colors it was captured with.
+inline void YV122RGB32 (const unsigned char *y,
+    const unsigned char *u,
+    const unsigned char *v,
+    unsigned width,
+    unsigned height,
+    unsigned char *rgb32)
+{
+    assert (y && u && v);
+    assert (rgb32);
+    assert (width % 2 == 0);
+    assert (height % 2 == 0);
+    if (width == 0)
+        return;
+    std::vector<unsigned char> yuyv_row (width * 2);
+    quint32 *d = reinterpret_cast<quint32 *> (rgb32);
+    for (unsigned row = 0; row < height; ++row)
+    {
+        const unsigned char *yrow = y + row * width;
+        const unsigned char *urow = u + (row / 2) * (width / 2);
+        const unsigned char *vrow = v + (row / 2) * (width / 2);
+        unsigned char *s = &yuyv_row[0];
+        for (unsigned i = 0; i < width / 2; ++i, s += 4)
+        {
+            s[0] = yrow[2 * i];
+            s[1] = urow[i];
+            s[2] = yrow[2 * i + 1];
+            s[3] = vrow[i];
+        }
+        const unsigned done = yuyv::ConvertRowSIMD (&yuyv_row[0], width, d, 0);
+        yuyv::ConvertRow (&yuyv_row[0], done, width, d, 0);
+        d += width;
+    }
+}
+
+} // namespace flying_dragon
+
+#endif // YUYV_H